@@ -0,0 +1,86 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+    Native plugin ABI.
+
+    A plugin is a shared library dropped into the plugins folder. It exports two
+    C functions: asterisk_plugin_abi_version (write ASTERISK_PLUGIN_DECLARE_ABI()
+    in one source file to get it), which the host checks against its own version
+    before anything else, and asterisk_plugin_register, which gets called once at
+    startup with an ast_host_api. Use api->register_function to add builtins.
+    Names that are already builtins can't be registered.
+
+    Everything in here is plain C so a plugin doesn't have to be built with the
+    same compiler (or standard library) as the interpreter. Bump
+    ASTERISK_PLUGIN_ABI_VERSION whenever a struct below changes layout.
+*/
+
+#define ASTERISK_PLUGIN_ABI_VERSION 2
+#define ASTERISK_PLUGIN_ENTRY "asterisk_plugin_register"
+#define ASTERISK_PLUGIN_ABI_ENTRY "asterisk_plugin_abi_version"
+
+#ifdef _WIN32
+#define ASTERISK_PLUGIN_EXPORT __declspec(dllexport)
+#else
+#define ASTERISK_PLUGIN_EXPORT __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+#define ASTERISK_PLUGIN_EXTERN_C extern "C"
+#else
+#define ASTERISK_PLUGIN_EXTERN_C
+#endif
+
+/* the version of this header the plugin was built against */
+#define ASTERISK_PLUGIN_DECLARE_ABI() \
+    ASTERISK_PLUGIN_EXTERN_C ASTERISK_PLUGIN_EXPORT uint32_t asterisk_plugin_abi_version(void) { \
+        return ASTERISK_PLUGIN_ABI_VERSION; \
+    }
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    AST_VALUE_INT = 0,
+    AST_VALUE_FLOAT = 1,
+    AST_VALUE_STRING = 2,
+    AST_VALUE_BOOL = 3,
+    AST_VALUE_ROOM = 4
+} ast_value_type;
+
+typedef struct ast_value {
+    int32_t type;
+    union {
+        int32_t i;
+        float f;
+        int32_t b;
+        struct { const char* data; size_t length; } s;
+        struct { const struct ast_value* items; size_t length; } room;
+    } as;
+} ast_value;
+
+/*
+    args only live for the duration of the call. Strings and ROOMs put in result
+    have to stay valid until the function returns (a static or thread_local
+    buffer is fine), the interpreter copies them right away.
+    A string with length 0 can have a null data pointer, anything longer can't.
+    Return 0 on success. Anything else is an error, and if result holds a string
+    it's used as the error message.
+*/
+typedef int (*ast_native_function)(const ast_value* args, size_t arg_count, ast_value* result, void* user_data);
+
+typedef struct ast_host_api {
+    uint32_t abi_version;
+    void* host;
+    int (*register_function)(void* host, const char* name, ast_native_function function, void* user_data);
+} ast_host_api;
+
+typedef int (*ast_plugin_register_function)(const ast_host_api* api);
+typedef uint32_t (*ast_plugin_abi_function)(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,395 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <stdexcept>
+#include <algorithm>
+
+// int + - * that report overflow instead of wrapping, the fast path for int values
+inline bool add_overflows(int a, int b, int& out) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_add_overflow(a, b, &out);
+#else
+    long long result = static_cast<long long>(a) + b;
+    out = static_cast<int>(result);
+    return result != out;
+#endif
+}
+
+// same for the 64-bit running totals (group_by sums), there's no wider type to fall back on
+inline bool add_overflows(int64_t a, int64_t b, int64_t& out) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_add_overflow(a, b, &out);
+#else
+    if ((b > 0 && a > INT64_MAX - b) || (b < 0 && a < INT64_MIN - b)) return true;
+    out = a + b;
+    return false;
+#endif
+}
+
+inline bool sub_overflows(int a, int b, int& out) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_sub_overflow(a, b, &out);
+#else
+    long long result = static_cast<long long>(a) - b;
+    out = static_cast<int>(result);
+    return result != out;
+#endif
+}
+
+inline bool mul_overflows(int a, int b, int& out) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_mul_overflow(a, b, &out);
+#else
+    long long result = static_cast<long long>(a) * b;
+    out = static_cast<int>(result);
+    return result != out;
+#endif
+}
+
+// Arbitrary precision integer, sign + magnitude in base 2^32 (least significant limb first).
+// Only used once an int overflows, so it favours being simple over being clever,
+// apart from multiplication which switches to Karatsuba for big operands.
+class BigInt {
+private:
+    using Limbs = std::vector<uint32_t>;
+
+    bool negative = false;
+    Limbs limbs;  // no leading zero limbs, zero is empty
+
+    static const size_t KARATSUBA_THRESHOLD = 32;
+
+    static void trim(Limbs& x) {
+        while (!x.empty() && x.back() == 0) x.pop_back();
+    }
+
+    static int compare_magnitude(const Limbs& a, const Limbs& b) {
+        if (a.size() != b.size()) return a.size() < b.size() ? -1 : 1;
+        for (size_t i = a.size(); i-- > 0;) {
+            if (a[i] != b[i]) return a[i] < b[i] ? -1 : 1;
+        }
+        return 0;
+    }
+
+    static Limbs add_magnitude(const Limbs& a, const Limbs& b) {
+        const Limbs& longer = a.size() >= b.size() ? a : b;
+        const Limbs& shorter = a.size() >= b.size() ? b : a;
+        Limbs result(longer.size() + 1);
+        uint64_t carry = 0;
+        for (size_t i = 0; i < longer.size(); ++i) {
+            uint64_t sum = carry + longer[i] + (i < shorter.size() ? shorter[i] : 0);
+            result[i] = static_cast<uint32_t>(sum);
+            carry = sum >> 32;
+        }
+        result[longer.size()] = static_cast<uint32_t>(carry);
+        trim(result);
+        return result;
+    }
+
+    // a - b, requires |a| >= |b|
+    static Limbs sub_magnitude(const Limbs& a, const Limbs& b) {
+        Limbs result(a.size());
+        int64_t borrow = 0;
+        for (size_t i = 0; i < a.size(); ++i) {
+            int64_t diff = static_cast<int64_t>(a[i]) - (i < b.size() ? b[i] : 0) - borrow;
+            borrow = diff < 0 ? 1 : 0;
+            result[i] = static_cast<uint32_t>(diff + (borrow << 32));
+        }
+        trim(result);
+        return result;
+    }
+
+    // target += x * 2^(32 * shift)
+    static void add_shifted(Limbs& target, const Limbs& x, size_t shift) {
+        if (target.size() < x.size() + shift + 1) target.resize(x.size() + shift + 1, 0);
+        uint64_t carry = 0;
+        size_t i = 0;
+        for (; i < x.size(); ++i) {
+            uint64_t sum = static_cast<uint64_t>(target[i + shift]) + x[i] + carry;
+            target[i + shift] = static_cast<uint32_t>(sum);
+            carry = sum >> 32;
+        }
+        for (size_t j = i + shift; carry != 0; ++j) {
+            if (j == target.size()) target.push_back(0);
+            uint64_t sum = static_cast<uint64_t>(target[j]) + carry;
+            target[j] = static_cast<uint32_t>(sum);
+            carry = sum >> 32;
+        }
+    }
+
+    static Limbs multiply_schoolbook(const Limbs& a, const Limbs& b) {
+        if (a.empty() || b.empty()) return {};
+        Limbs result(a.size() + b.size(), 0);
+        for (size_t i = 0; i < a.size(); ++i) {
+            uint64_t carry = 0;
+            for (size_t j = 0; j < b.size(); ++j) {
+                uint64_t product = static_cast<uint64_t>(a[i]) * b[j] + result[i + j] + carry;
+                result[i + j] = static_cast<uint32_t>(product);
+                carry = product >> 32;
+            }
+            result[i + b.size()] = static_cast<uint32_t>(carry);
+        }
+        trim(result);
+        return result;
+    }
+
+    static Limbs multiply_magnitude(const Limbs& a, const Limbs& b) {
+        if (std::min(a.size(), b.size()) < KARATSUBA_THRESHOLD) {
+            return multiply_schoolbook(a, b);
+        }
+
+        // a = a1 * B + a0, b = b1 * B + b0 with B = 2^(32 * half)
+        size_t half = std::max(a.size(), b.size()) / 2;
+        auto split = [half](const Limbs& x, Limbs& low, Limbs& high) {
+            size_t cut = std::min(half, x.size());
+            low.assign(x.begin(), x.begin() + cut);
+            high.assign(x.begin() + cut, x.end());
+            trim(low);
+        };
+        Limbs a0, a1, b0, b1;
+        split(a, a0, a1);
+        split(b, b0, b1);
+
+        Limbs z0 = multiply_magnitude(a0, b0);
+        Limbs z2 = multiply_magnitude(a1, b1);
+        Limbs z1 = multiply_magnitude(add_magnitude(a0, a1), add_magnitude(b0, b1));
+        z1 = sub_magnitude(sub_magnitude(z1, z0), z2);
+
+        Limbs result = z0;
+        add_shifted(result, z1, half);
+        add_shifted(result, z2, 2 * half);
+        trim(result);
+        return result;
+    }
+
+    static Limbs divide_small(const Limbs& a, uint32_t divisor, uint32_t& remainder) {
+        Limbs quotient(a.size());
+        uint64_t rem = 0;
+        for (size_t i = a.size(); i-- > 0;) {
+            uint64_t current = (rem << 32) | a[i];
+            quotient[i] = static_cast<uint32_t>(current / divisor);
+            rem = current % divisor;
+        }
+        remainder = static_cast<uint32_t>(rem);
+        trim(quotient);
+        return quotient;
+    }
+
+    // Knuth's algorithm D (as written up in Hacker's Delight, divmnu)
+    static void divide_magnitude(const Limbs& u, const Limbs& v, Limbs& quotient, Limbs& remainder) {
+        if (compare_magnitude(u, v) < 0) {
+            quotient.clear();
+            remainder = u;
+            return;
+        }
+        if (v.size() == 1) {
+            uint32_t rem;
+            quotient = divide_small(u, v[0], rem);
+            remainder.clear();
+            if (rem != 0) remainder.push_back(rem);
+            return;
+        }
+
+        const size_t n = v.size();
+        const size_t m = u.size();
+
+        int shift = 0;
+        for (uint32_t top = v.back(); (top & 0x80000000u) == 0; top <<= 1) ++shift;
+
+        Limbs vn(n), un(m + 1);
+        for (size_t i = n - 1; i > 0; --i) {
+            vn[i] = static_cast<uint32_t>((static_cast<uint64_t>(v[i]) << shift) | (static_cast<uint64_t>(v[i - 1]) >> (32 - shift)));
+        }
+        vn[0] = v[0] << shift;
+        un[m] = static_cast<uint32_t>(static_cast<uint64_t>(u[m - 1]) >> (32 - shift));
+        for (size_t i = m - 1; i > 0; --i) {
+            un[i] = static_cast<uint32_t>((static_cast<uint64_t>(u[i]) << shift) | (static_cast<uint64_t>(u[i - 1]) >> (32 - shift)));
+        }
+        un[0] = u[0] << shift;
+
+        const uint64_t base = 1ULL << 32;
+        quotient.assign(m - n + 1, 0);
+        for (size_t j = m - n + 1; j-- > 0;) {
+            uint64_t numerator = (static_cast<uint64_t>(un[j + n]) << 32) | un[j + n - 1];
+            uint64_t qhat = numerator / vn[n - 1];
+            uint64_t rhat = numerator % vn[n - 1];
+            while (qhat >= base || qhat * vn[n - 2] > ((rhat << 32) | un[j + n - 2])) {
+                --qhat;
+                rhat += vn[n - 1];
+                if (rhat >= base) break;
+            }
+
+            int64_t borrow = 0;
+            int64_t t;
+            for (size_t i = 0; i < n; ++i) {
+                uint64_t product = qhat * vn[i];
+                t = static_cast<int64_t>(un[i + j]) - borrow - static_cast<int64_t>(product & 0xFFFFFFFFu);
+                un[i + j] = static_cast<uint32_t>(t);
+                borrow = static_cast<int64_t>(product >> 32) - (t >> 32);
+            }
+            t = static_cast<int64_t>(un[j + n]) - borrow;
+            un[j + n] = static_cast<uint32_t>(t);
+
+            quotient[j] = static_cast<uint32_t>(qhat);
+            if (t < 0) {
+                // qhat was one too big, add the divisor back
+                quotient[j] -= 1;
+                uint64_t carry = 0;
+                for (size_t i = 0; i < n; ++i) {
+                    uint64_t sum = static_cast<uint64_t>(un[i + j]) + vn[i] + carry;
+                    un[i + j] = static_cast<uint32_t>(sum);
+                    carry = sum >> 32;
+                }
+                un[j + n] = static_cast<uint32_t>(un[j + n] + carry);
+            }
+        }
+
+        remainder.assign(n, 0);
+        for (size_t i = 0; i < n; ++i) {
+            remainder[i] = static_cast<uint32_t>((static_cast<uint64_t>(un[i]) >> shift) |
+                                                 (static_cast<uint64_t>(un[i + 1]) << (32 - shift)));
+        }
+        trim(quotient);
+        trim(remainder);
+    }
+
+    static BigInt make(bool negative, Limbs limbs) {
+        BigInt result;
+        result.limbs = std::move(limbs);
+        result.negative = negative && !result.limbs.empty();
+        return result;
+    }
+
+public:
+    BigInt() = default;
+
+    BigInt(int64_t value) {
+        negative = value < 0;
+        uint64_t magnitude = negative ? 0 - static_cast<uint64_t>(value) : static_cast<uint64_t>(value);
+        while (magnitude != 0) {
+            limbs.push_back(static_cast<uint32_t>(magnitude));
+            magnitude >>= 32;
+        }
+    }
+
+    // decimal digits with an optional leading '-'
+    static BigInt from_string(const std::string& text) {
+        size_t i = 0;
+        bool is_negative = false;
+        if (i < text.size() && (text[i] == '-' || text[i] == '+')) {
+            is_negative = text[i] == '-';
+            ++i;
+        }
+        if (i == text.size()) {
+            throw std::runtime_error("Invalid integer: " + text);
+        }
+
+        Limbs result;
+        for (; i < text.size(); ++i) {
+            if (text[i] < '0' || text[i] > '9') {
+                throw std::runtime_error("Invalid integer: " + text);
+            }
+            uint64_t carry = static_cast<uint64_t>(text[i] - '0');
+            for (auto& limb : result) {
+                uint64_t current = static_cast<uint64_t>(limb) * 10 + carry;
+                limb = static_cast<uint32_t>(current);
+                carry = current >> 32;
+            }
+            if (carry != 0) result.push_back(static_cast<uint32_t>(carry));
+        }
+        trim(result);
+        return make(is_negative, std::move(result));
+    }
+
+    bool is_zero() const { return limbs.empty(); }
+    bool is_negative() const { return negative; }
+
+    bool fits_int() const {
+        if (limbs.size() > 1) return false;
+        if (limbs.empty()) return true;
+        return negative ? limbs[0] <= 0x80000000u : limbs[0] <= 0x7FFFFFFFu;
+    }
+
+    int to_int() const {
+        if (limbs.empty()) return 0;
+        int64_t magnitude = limbs[0];
+        return static_cast<int>(negative ? -magnitude : magnitude);
+    }
+
+    double to_double() const {
+        double result = 0.0;
+        for (size_t i = limbs.size(); i-- > 0;) {
+            result = result * 4294967296.0 + limbs[i];
+        }
+        return negative ? -result : result;
+    }
+
+    std::string to_string() const {
+        if (limbs.empty()) return "0";
+
+        std::vector<uint32_t> chunks;  // base 10^9, least significant first
+        Limbs current = limbs;
+        while (!current.empty()) {
+            uint32_t chunk;
+            current = divide_small(current, 1000000000u, chunk);
+            chunks.push_back(chunk);
+        }
+
+        std::string result = negative ? "-" : "";
+        result += std::to_string(chunks.back());
+        for (size_t i = chunks.size() - 1; i-- > 0;) {
+            std::string digits = std::to_string(chunks[i]);
+            result += std::string(9 - digits.size(), '0') + digits;
+        }
+        return result;
+    }
+
+    BigInt abs() const {
+        return make(false, limbs);
+    }
+
+    BigInt operator-() const {
+        return make(!negative, limbs);
+    }
+
+    friend BigInt operator+(const BigInt& a, const BigInt& b) {
+        if (a.negative == b.negative) {
+            return make(a.negative, add_magnitude(a.limbs, b.limbs));
+        }
+        if (compare_magnitude(a.limbs, b.limbs) >= 0) {
+            return make(a.negative, sub_magnitude(a.limbs, b.limbs));
+        }
+        return make(b.negative, sub_magnitude(b.limbs, a.limbs));
+    }
+
+    friend BigInt operator-(const BigInt& a, const BigInt& b) {
+        return a + (-b);
+    }
+
+    friend BigInt operator*(const BigInt& a, const BigInt& b) {
+        return make(a.negative != b.negative, multiply_magnitude(a.limbs, b.limbs));
+    }
+
+    // truncates towards zero like int division does
+    friend BigInt operator/(const BigInt& a, const BigInt& b) {
+        if (b.is_zero()) throw std::runtime_error("Division by zero");
+        Limbs quotient, remainder;
+        divide_magnitude(a.limbs, b.limbs, quotient, remainder);
+        return make(a.negative != b.negative, std::move(quotient));
+    }
+
+    friend BigInt operator%(const BigInt& a, const BigInt& b) {
+        if (b.is_zero()) throw std::runtime_error("Division by zero");
+        Limbs quotient, remainder;
+        divide_magnitude(a.limbs, b.limbs, quotient, remainder);
+        return make(a.negative, std::move(remainder));
+    }
+
+    friend bool operator==(const BigInt& a, const BigInt& b) {
+        return a.negative == b.negative && a.limbs == b.limbs;
+    }
+
+    friend bool operator!=(const BigInt& a, const BigInt& b) {
+        return !(a == b);
+    }
+};
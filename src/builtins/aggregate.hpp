@@ -0,0 +1,177 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <thread>
+#include <exception>
+#include <algorithm>
+#include <unordered_map>
+#include <functional>
+#include <cstdint>
+#include <stdexcept>
+#include "../parser/functions.hpp"
+
+enum class Aggregate { SUM, COUNT, MIN, MAX, MEAN };
+
+struct PartialAggregate {
+    size_t first_row = SIZE_MAX;  // so groups come out in the order they first show up
+    int64_t count = 0;
+    int64_t int_sum = 0;
+    BigInt spilled_sum;  // whatever int_sum held each time adding to it would have overflowed
+    double float_sum = 0.0;
+    double min = INFINITY;
+    double max = -INFINITY;
+    bool only_ints = true;
+
+    void add_int(int64_t x) {
+        int64_t sum;
+        if (!add_overflows(int_sum, x, sum)) {
+            int_sum = sum;
+            return;
+        }
+        spilled_sum = spilled_sum + BigInt(int_sum);
+        int_sum = x;
+    }
+
+    void add(size_t row, const Value& value, Aggregate aggregate) {
+        if (first_row == SIZE_MAX) first_row = row;
+        ++count;
+        if (aggregate == Aggregate::COUNT) return;
+
+        if (auto i = value.get_if<int>()) {
+            add_int(*i);
+        } else if (auto b = value.get_if<bool>()) {
+            add_int(*b ? 1 : 0);
+        } else {
+            only_ints = false;
+        }
+        double x = value_to_double(value, "group_by");
+        float_sum += x;
+        min = std::min(min, x);
+        max = std::max(max, x);
+    }
+
+    void merge(const PartialAggregate& other) {
+        first_row = std::min(first_row, other.first_row);
+        count += other.count;
+        add_int(other.int_sum);
+        if (!other.spilled_sum.is_zero()) spilled_sum = spilled_sum + other.spilled_sum;
+        float_sum += other.float_sum;
+        min = std::min(min, other.min);
+        max = std::max(max, other.max);
+        only_ints = only_ints && other.only_ints;
+    }
+
+    Value result(Aggregate aggregate) const {
+        switch (aggregate) {
+            case Aggregate::SUM:
+                if (only_ints) return normalize_integer(spilled_sum + BigInt(int_sum));
+                return static_cast<float>(float_sum);
+            case Aggregate::COUNT:
+                return normalize_integer(BigInt(count));
+            case Aggregate::MIN:
+                if (only_ints) return static_cast<int>(min);
+                return static_cast<float>(min);
+            case Aggregate::MAX:
+                if (only_ints) return static_cast<int>(max);
+                return static_cast<float>(max);
+            case Aggregate::MEAN:
+                return static_cast<float>(float_sum / static_cast<double>(count));
+        }
+        return 0;
+    }
+};
+
+using PartialTable = std::unordered_map<const Value*, PartialAggregate, ValueKeyHash, ValueKeyEqual>;
+
+// below this many rows starting threads costs more than it saves
+const size_t GROUP_BY_PARALLEL_ROWS = 1 << 16;
+
+Value group_by(const ValueArray& keys, const ValueArray& values, Aggregate aggregate) {
+    size_t rows = keys.size();
+    size_t partitions = 1;
+    if (rows >= GROUP_BY_PARALLEL_ROWS) {
+        partitions = std::max(1u, std::thread::hardware_concurrency());
+        partitions = std::min(partitions, rows / (GROUP_BY_PARALLEL_ROWS / 4));
+    }
+
+    // every partition aggregates its own slice into a private table, no locking needed
+    std::vector<PartialTable> tables(partitions);
+    std::vector<std::exception_ptr> errors(partitions);
+    auto aggregate_slice = [&](size_t part) {
+        try {
+            size_t begin = rows * part / partitions;
+            size_t end = rows * (part + 1) / partitions;
+            PartialTable& table = tables[part];
+            for (size_t row = begin; row < end; ++row) {
+                table[&keys[row]].add(row, values[row], aggregate);
+            }
+        } catch (...) {
+            errors[part] = std::current_exception();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t part = 1; part < partitions; ++part) {
+        workers.emplace_back(aggregate_slice, part);
+    }
+    aggregate_slice(0);
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    for (const auto& error : errors) {
+        if (error) std::rethrow_exception(error);
+    }
+
+    PartialTable& merged = tables[0];
+    for (size_t part = 1; part < partitions; ++part) {
+        for (const auto& [key, partial] : tables[part]) {
+            merged[key].merge(partial);
+        }
+    }
+
+    std::vector<std::pair<const Value*, const PartialAggregate*>> groups;
+    groups.reserve(merged.size());
+    for (const auto& [key, partial] : merged) {
+        groups.emplace_back(key, &partial);
+    }
+    std::sort(groups.begin(), groups.end(), [](const auto& a, const auto& b) {
+        return a.second->first_row < b.second->first_row;
+    });
+
+    ValueMap result;
+    for (const auto& [key, partial] : groups) {
+        result.set(*key, partial->result(aggregate));
+    }
+    return result;
+}
+
+void register_aggregate_functions(FunctionRegistry& registry) {
+    registry.register_function("group_by", [](const ValueVector& args) -> Value {
+        if (args.size() != 3) {
+            throw std::runtime_error("group_by() expects exactly 3 arguments");
+        }
+        if (!args[0].get_if<ValueArray>() || !args[1].get_if<ValueArray>()) {
+            throw std::runtime_error("group_by() requires arrays as first and second arguments");
+        }
+        if (!args[2].get_if<std::string>()) {
+            throw std::runtime_error("group_by() requires an aggregate name as third argument");
+        }
+
+        const ValueArray& keys = args[0].get<ValueArray>();
+        const ValueArray& values = args[1].get<ValueArray>();
+        if (keys.size() != values.size()) {
+            throw std::runtime_error("group_by() requires arrays of the same length");
+        }
+
+        static const std::unordered_map<std::string, Aggregate> aggregates = {
+            {"sum", Aggregate::SUM}, {"count", Aggregate::COUNT}, {"min", Aggregate::MIN},
+            {"max", Aggregate::MAX}, {"mean", Aggregate::MEAN}
+        };
+        auto it = aggregates.find(args[2].get<std::string>());
+        if (it == aggregates.end()) {
+            throw std::runtime_error("group_by() aggregate must be sum, count, min, max or mean");
+        }
+
+        return group_by(keys, values, it->second);
+    });
+}
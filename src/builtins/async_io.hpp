@@ -0,0 +1,96 @@
+#pragma once
+#include <string>
+#include <memory>
+#include <future>
+#include <chrono>
+#include <cstdio>
+#include <stdexcept>
+#include "../parser/functions.hpp"
+#include "../thread_pool.hpp"
+#include "handles.hpp"
+
+// Blocking file calls run on an I/O pool, the script gets a handle to poll or wait on.
+// Mostly waiting on the disk, so more threads than cores is fine.
+const size_t ASYNC_IO_THREADS = 16;
+
+std::string read_file_contents(const std::string& path) {
+    FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file) {
+        throw std::runtime_error("Failed to open file: " + path);
+    }
+    std::string contents;
+    char buffer[1 << 16];
+    size_t got;
+    while ((got = std::fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        contents.append(buffer, got);
+    }
+    bool failed = std::ferror(file) != 0;
+    std::fclose(file);
+    if (failed) {
+        throw std::runtime_error("Failed to read file: " + path);
+    }
+    return contents;
+}
+
+void write_file_contents(const std::string& path, const std::string& contents) {
+    FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file) {
+        throw std::runtime_error("Failed to open file: " + path);
+    }
+    size_t written = std::fwrite(contents.data(), 1, contents.size(), file);
+    bool closed = std::fclose(file) == 0;
+    if (written != contents.size() || !closed) {
+        throw std::runtime_error("Failed to write file: " + path);
+    }
+}
+
+void register_async_io_functions(FunctionRegistry& registry) {
+    // the pool finishes whatever is still queued before it shuts down, so pending writes aren't lost at exit
+    auto pending = std::make_shared<HandleTable<std::shared_future<Value>>>();
+    auto pool = std::make_shared<ThreadPool>(ASYNC_IO_THREADS);
+
+    auto start = [pending, pool](std::function<Value()> job) -> Value {
+        auto task = std::make_shared<std::packaged_task<Value()>>(std::move(job));
+        auto result = std::make_shared<std::shared_future<Value>>(task->get_future().share());
+        pool->submit([task] { (*task)(); });
+        return pending->add(result);
+    };
+
+    registry.register_function("async_read", [start](const ValueVector& args) -> Value {
+        if (args.size() != 1 || !args[0].get_if<std::string>()) {
+            throw std::runtime_error("async_read() expects exactly 1 path argument");
+        }
+        std::string path = args[0].get<std::string>();
+        return start([path]() -> Value { return read_file_contents(path); });
+    });
+
+    registry.register_function("async_write", [start](const ValueVector& args) -> Value {
+        if (args.size() != 2 || !args[0].get_if<std::string>() || !args[1].get_if<std::string>()) {
+            throw std::runtime_error("async_write() expects a path and a string");
+        }
+        std::string path = args[0].get<std::string>();
+        std::string contents = args[1].get<std::string>();
+        return start([path, contents]() -> Value {
+            write_file_contents(path, contents);
+            return static_cast<int>(contents.size());
+        });
+    });
+
+    registry.register_function("io_ready", [pending](const ValueVector& args) -> Value {
+        if (args.size() != 1) {
+            throw std::runtime_error("io_ready() expects exactly 1 argument");
+        }
+        auto result = pending->get(args[0], "io_ready");
+        return result->wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    });
+
+    // blocks until it's done, then gives back the file contents (reads) or bytes written (writes)
+    registry.register_function("await_io", [pending](const ValueVector& args) -> Value {
+        if (args.size() != 1) {
+            throw std::runtime_error("await_io() expects exactly 1 argument");
+        }
+        auto result = pending->get(args[0], "await_io");
+        pending->remove(args[0], "await_io");
+        return result->get();
+    });
+}
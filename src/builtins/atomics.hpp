@@ -0,0 +1,248 @@
+#pragma once
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <stdexcept>
+#include <algorithm>
+#include "../parser/functions.hpp"
+#include "handles.hpp"
+
+/*
+    Shared counters for parallel code (pfor bodies, tasks, isolates). Ints are kept as 64-bit
+    and come back as a BigInt if they outgrow an int, floats are summed as doubles. An atomic
+    is one cell everyone hits. An accumulator gives every thread a shard of its own on its own
+    cache line and only adds the shards up when it's read, so busy loops don't fight over it.
+*/
+
+// std::atomic<double> only gets fetch_add in C++20
+double atomic_fetch_add(std::atomic<double>& cell, double delta) {
+    double old_value = cell.load(std::memory_order_relaxed);
+    while (!cell.compare_exchange_weak(old_value, old_value + delta, std::memory_order_relaxed)) {}
+    return old_value;
+}
+
+int64_t atomic_fetch_add(std::atomic<int64_t>& cell, int64_t delta) {
+    return cell.fetch_add(delta, std::memory_order_relaxed);
+}
+
+Value counter_value(int64_t value) {
+    return normalize_integer(BigInt(value));
+}
+
+Value counter_value(double value) {
+    return static_cast<float>(value);
+}
+
+// the numbers a counter of type T will take, ints only go into int counters
+template<typename T>
+T counter_delta(const Value& value, const std::string& function_name) {
+    if (auto i = value.get_if<int>()) return static_cast<T>(*i);
+    if constexpr (std::is_same_v<T, double>) {
+        if (auto f = value.get_if<float>()) return *f;
+        throw std::runtime_error(function_name + "() needs a number");
+    } else {
+        throw std::runtime_error(function_name + "() needs an int for an int counter");
+    }
+}
+
+class AtomicCounter {
+private:
+    bool is_float;
+    std::atomic<int64_t> int_value{0};
+    std::atomic<double> float_value{0};
+
+public:
+    explicit AtomicCounter(const Value& initial) : is_float(initial.get_if<float>() != nullptr) {
+        if (is_float) float_value.store(initial.get<float>());
+        else int_value.store(counter_delta<int64_t>(initial, "atomic"));
+    }
+
+    // gives back the value after the add, like x = x + delta would
+    Value add(const Value& delta) {
+        if (is_float) {
+            double d = counter_delta<double>(delta, "atomic_add");
+            return counter_value(atomic_fetch_add(float_value, d) + d);
+        }
+        int64_t d = counter_delta<int64_t>(delta, "atomic_add");
+        return counter_value(atomic_fetch_add(int_value, d) + d);
+    }
+
+    // sets it to desired only if it's still expected, true if it did
+    bool compare_and_swap(const Value& expected, const Value& desired) {
+        if (is_float) {
+            double want = counter_delta<double>(expected, "atomic_cas");
+            return float_value.compare_exchange_strong(want, counter_delta<double>(desired, "atomic_cas"));
+        }
+        int64_t want = counter_delta<int64_t>(expected, "atomic_cas");
+        return int_value.compare_exchange_strong(want, counter_delta<int64_t>(desired, "atomic_cas"));
+    }
+
+    Value load() const {
+        return is_float ? counter_value(float_value.load()) : counter_value(int_value.load());
+    }
+};
+
+// which shard this thread adds to, handed out round robin as threads first show up
+size_t accumulator_shard() {
+    static std::atomic<size_t> next_thread{0};
+    thread_local size_t shard = next_thread.fetch_add(1, std::memory_order_relaxed);
+    return shard;
+}
+
+template<typename T>
+class ShardedAccumulator {
+private:
+    static constexpr size_t SLOTS_PER_LINE = 64 / sizeof(std::atomic<T>);
+
+    struct alignas(64) Line {
+        std::atomic<T> slots[SLOTS_PER_LINE];
+    };
+
+    size_t buckets;
+    size_t lines_per_shard;
+    size_t shards;
+    std::vector<Line> lines;
+
+public:
+    ShardedAccumulator(T initial, size_t bucket_count)
+        : buckets(bucket_count), lines_per_shard((bucket_count + SLOTS_PER_LINE - 1) / SLOTS_PER_LINE),
+          shards(std::min<size_t>(64, std::max(1u, std::thread::hardware_concurrency()) * 2)),
+          lines(shards * lines_per_shard) {
+        for (auto& line : lines) {
+            for (auto& slot : line.slots) slot.store(0, std::memory_order_relaxed);
+        }
+        // the starting value lives in shard 0, so it's counted once per bucket
+        for (size_t bucket = 0; bucket < buckets; ++bucket) {
+            lines[bucket / SLOTS_PER_LINE].slots[bucket % SLOTS_PER_LINE].store(initial, std::memory_order_relaxed);
+        }
+    }
+
+    void add(size_t bucket, T delta) {
+        Line& line = lines[(accumulator_shard() % shards) * lines_per_shard + bucket / SLOTS_PER_LINE];
+        atomic_fetch_add(line.slots[bucket % SLOTS_PER_LINE], delta);
+    }
+
+    // exact once the adding threads are done, a recent total while they're still going
+    T total(size_t bucket) const {
+        T sum = 0;
+        for (size_t shard = 0; shard < shards; ++shard) {
+            sum += lines[shard * lines_per_shard + bucket / SLOTS_PER_LINE].slots[bucket % SLOTS_PER_LINE].load(std::memory_order_relaxed);
+        }
+        return sum;
+    }
+};
+
+// a plain running total, or with buckets a histogram where each bucket is a total of its own
+class Accumulator {
+private:
+    bool is_float;
+    bool bucketed;
+    size_t buckets;
+    std::unique_ptr<ShardedAccumulator<int64_t>> ints;
+    std::unique_ptr<ShardedAccumulator<double>> floats;
+
+public:
+    Accumulator(const Value& initial, size_t bucket_count, bool with_buckets)
+        : is_float(initial.get_if<float>() != nullptr), bucketed(with_buckets), buckets(bucket_count) {
+        if (is_float) floats = std::make_unique<ShardedAccumulator<double>>(initial.get<float>(), buckets);
+        else ints = std::make_unique<ShardedAccumulator<int64_t>>(counter_delta<int64_t>(initial, "accumulator"), buckets);
+    }
+
+    // acc_add(acc, x) or acc_add(acc, x, bucket)
+    void add(const ValueVector& args) {
+        size_t bucket = 0;
+        if (bucketed) {
+            if (args.size() != 3 || !args[2].get_if<int>()) {
+                throw std::runtime_error("acc_add() on a bucketed accumulator expects a number and a bucket");
+            }
+            int index = args[2].get<int>();
+            if (index < 0 || static_cast<size_t>(index) >= buckets) {
+                throw std::runtime_error("acc_add() bucket out of range");
+            }
+            bucket = static_cast<size_t>(index);
+        } else if (args.size() != 2) {
+            throw std::runtime_error("acc_add() expects an accumulator and a number");
+        }
+        if (is_float) floats->add(bucket, counter_delta<double>(args[1], "acc_add"));
+        else ints->add(bucket, counter_delta<int64_t>(args[1], "acc_add"));
+    }
+
+    Value load() const {
+        auto total = [this](size_t bucket) {
+            return is_float ? counter_value(floats->total(bucket)) : counter_value(ints->total(bucket));
+        };
+        if (!bucketed) return total(0);
+        ValueVector totals;
+        totals.reserve(buckets);
+        for (size_t bucket = 0; bucket < buckets; ++bucket) {
+            totals.push_back(total(bucket));
+        }
+        return ValueArray(std::move(totals));
+    }
+};
+
+void register_atomic_functions(FunctionRegistry& registry) {
+    auto counters = std::make_shared<HandleTable<AtomicCounter>>();
+    auto accumulators = std::make_shared<HandleTable<Accumulator>>();
+
+    registry.register_function("atomic", [counters](const ValueVector& args) -> Value {
+        if (args.size() != 1 || (!args[0].get_if<int>() && !args[0].get_if<float>())) {
+            throw std::runtime_error("atomic() expects a starting int or float");
+        }
+        return counters->add(std::make_shared<AtomicCounter>(args[0]));
+    });
+
+    registry.register_function("atomic_add", [counters](const ValueVector& args) -> Value {
+        if (args.size() != 2) {
+            throw std::runtime_error("atomic_add() expects an atomic and a number");
+        }
+        return counters->get(args[0], "atomic_add")->add(args[1]);
+    });
+
+    registry.register_function("atomic_cas", [counters](const ValueVector& args) -> Value {
+        if (args.size() != 3) {
+            throw std::runtime_error("atomic_cas() expects an atomic, the expected value and the new value");
+        }
+        return counters->get(args[0], "atomic_cas")->compare_and_swap(args[1], args[2]);
+    });
+
+    registry.register_function("atomic_load", [counters](const ValueVector& args) -> Value {
+        if (args.size() != 1) {
+            throw std::runtime_error("atomic_load() expects exactly 1 argument");
+        }
+        return counters->get(args[0], "atomic_load")->load();
+    });
+
+    // accumulator(start) or accumulator(start, buckets) for a histogram
+    registry.register_function("accumulator", [accumulators](const ValueVector& args) -> Value {
+        if (args.empty() || args.size() > 2 || (!args[0].get_if<int>() && !args[0].get_if<float>())) {
+            throw std::runtime_error("accumulator() expects a starting int or float and optionally a bucket count");
+        }
+        size_t buckets = 1;
+        if (args.size() == 2) {
+            if (!args[1].get_if<int>() || args[1].get<int>() <= 0) {
+                throw std::runtime_error("accumulator() expects a positive bucket count");
+            }
+            buckets = static_cast<size_t>(args[1].get<int>());
+        }
+        return accumulators->add(std::make_shared<Accumulator>(args[0], buckets, args.size() == 2));
+    });
+
+    registry.register_function("acc_add", [accumulators](const ValueVector& args) -> Value {
+        if (args.empty()) {
+            throw std::runtime_error("acc_add() expects an accumulator and a number");
+        }
+        accumulators->get(args[0], "acc_add")->add(args);
+        return 0;
+    });
+
+    // adds the shards up
+    registry.register_function("acc_load", [accumulators](const ValueVector& args) -> Value {
+        if (args.size() != 1) {
+            throw std::runtime_error("acc_load() expects exactly 1 argument");
+        }
+        return accumulators->get(args[0], "acc_load")->load();
+    });
+}
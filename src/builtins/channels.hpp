@@ -0,0 +1,226 @@
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <stdexcept>
+#include "../parser/functions.hpp"
+#include "handles.hpp"
+
+/*
+    Bounded channel between tasks. The queue itself is Vyukov's bounded MPMC ring: every cell
+    carries a sequence number that says whose turn it is, so senders and receivers only ever
+    CAS a position counter and never take a lock. The lock and condition variables are only
+    there for sleeping when the ring is full (senders) or empty (receivers), and the *_waiting
+    counters let the other side skip them when nobody is asleep.
+
+    close() can land between a sender's closed check and its push. That send still counts (it
+    started first), so senders_pushing covers the check and the push, and nobody calls the
+    channel drained while a push is in flight.
+*/
+class Channel {
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        Value value;
+    };
+
+    std::vector<Cell> cells;
+    const size_t size;
+    std::atomic<size_t> enqueue_pos{0};
+    std::atomic<size_t> dequeue_pos{0};
+    std::atomic<bool> closed{false};
+
+    std::mutex mutex;
+    std::condition_variable space_ready;
+    std::condition_variable value_ready;
+    std::atomic<int> senders_waiting{0};
+    std::atomic<int> receivers_waiting{0};
+    std::atomic<int> senders_pushing{0};
+
+    bool try_push(Value& value) {
+        size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells[pos % size];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1)) {
+                    cell.value = std::move(value);
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;  // full
+            } else {
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool try_pop(Value& value) {
+        size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells[pos % size];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (dequeue_pos.compare_exchange_weak(pos, pos + 1)) {
+                    value = std::move(cell.value);
+                    cell.sequence.store(pos + size, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;  // empty
+            } else {
+                pos = dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void wake(std::condition_variable& condition, std::atomic<int>& waiting) {
+        if (waiting.load() > 0) {
+            std::lock_guard<std::mutex> lock(mutex);
+            condition.notify_all();
+        }
+    }
+
+    size_t queued() const {
+        return enqueue_pos.load() - dequeue_pos.load();
+    }
+
+    bool closed_for_good() const {
+        return closed.load() && senders_pushing.load() == 0;
+    }
+
+public:
+    // the ring needs at least 2 cells to tell "full" from "empty" apart
+    explicit Channel(size_t capacity) : cells(std::max<size_t>(capacity, 2)), size(cells.size()) {
+        for (size_t i = 0; i < size; ++i) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    void send(Value value) {
+        while (true) {
+            ++senders_pushing;
+            bool pushed = !closed.load() && try_push(value);
+            --senders_pushing;
+            if (pushed || closed.load()) {
+                // receivers that saw the close wait for the push to finish
+                wake(value_ready, receivers_waiting);
+            }
+            if (pushed) return;
+            if (closed.load()) {
+                throw std::runtime_error("send() on a closed channel");
+            }
+            std::unique_lock<std::mutex> lock(mutex);
+            ++senders_waiting;
+            space_ready.wait(lock, [this] { return closed.load() || queued() < size; });
+            --senders_waiting;
+        }
+    }
+
+    // false once the channel is closed and everything sent has been received
+    bool receive(Value& value) {
+        while (true) {
+            if (try_pop(value)) {
+                wake(space_ready, senders_waiting);
+                return true;
+            }
+            if (closed_for_good()) {
+                // one last look, a send might have landed just before the close
+                return try_pop(value);
+            }
+            std::unique_lock<std::mutex> lock(mutex);
+            ++receivers_waiting;
+            value_ready.wait(lock, [this] { return closed_for_good() || queued() > 0; });
+            --receivers_waiting;
+        }
+    }
+
+    bool try_receive(Value& value) {
+        if (!try_pop(value)) return false;
+        wake(space_ready, senders_waiting);
+        return true;
+    }
+
+    // closed with nothing left in it, nobody can get anything more out of it
+    bool drained() const {
+        return closed_for_good() && queued() == 0;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed.store(true);
+        space_ready.notify_all();
+        value_ready.notify_all();
+    }
+};
+
+// A closed channel's handle goes once it's drained, so long-running scripts don't keep a ring per
+// channel forever. Anyone still waiting on it holds their own reference, and later calls with the
+// handle see a closed channel.
+void register_channel_functions(FunctionRegistry& registry) {
+    auto channels = std::make_shared<HandleTable<Channel>>();
+
+    registry.register_function("chan", [channels](const ValueVector& args) -> Value {
+        if (args.size() != 1 || !args[0].get_if<int>() || args[0].get<int>() <= 0) {
+            throw std::runtime_error("chan() expects a positive capacity");
+        }
+        return channels->add(std::make_shared<Channel>(static_cast<size_t>(args[0].get<int>())));
+    });
+
+    // blocks while the channel is full
+    registry.register_function("send", [channels](const ValueVector& args) -> Value {
+        if (args.size() != 2) {
+            throw std::runtime_error("send() expects a channel and a value");
+        }
+        auto channel = channels->find(args[0], "send");
+        if (!channel) {
+            throw std::runtime_error("send() on a closed channel");
+        }
+        channel->send(args[1]);
+        return 0;
+    });
+
+    // Blocks while the channel is empty. Gives back [value, true], or [0, false] once it's closed
+    // and drained, so a channel can carry false like anything else.
+    registry.register_function("recv", [channels](const ValueVector& args) -> Value {
+        if (args.size() != 1) {
+            throw std::runtime_error("recv() expects exactly 1 argument");
+        }
+        Value value;
+        auto channel = channels->find(args[0], "recv");
+        bool received = channel && channel->receive(value);
+        if (!received) channels->discard(args[0]);
+        return ValueArray({std::move(value), received});
+    });
+
+    // never blocks, [0, false] when there's nothing waiting
+    registry.register_function("try_recv", [channels](const ValueVector& args) -> Value {
+        if (args.size() != 1) {
+            throw std::runtime_error("try_recv() expects exactly 1 argument");
+        }
+        Value value;
+        auto channel = channels->find(args[0], "try_recv");
+        bool received = channel && channel->try_receive(value);
+        if (!received && channel && channel->drained()) channels->discard(args[0]);
+        return ValueArray({std::move(value), received});
+    });
+
+    // receivers get what's already queued, then [0, false]; sending afterwards is an error
+    registry.register_function("close", [channels](const ValueVector& args) -> Value {
+        if (args.size() != 1) {
+            throw std::runtime_error("close() expects exactly 1 argument");
+        }
+        auto channel = channels->find(args[0], "close");
+        if (channel) {
+            channel->close();
+            if (channel->drained()) channels->discard(args[0]);
+        }
+        return 0;
+    });
+}
@@ -0,0 +1,350 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <cstring>
+#include <charconv>
+#include <algorithm>
+#include <stdexcept>
+#include "../parser/functions.hpp"
+#include "handles.hpp"
+#include "io.hpp"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// first ',', '"', '\r' or '\n' at or after p (end if there isn't one)
+const char* find_csv_special(const char* p, const char* end) {
+#if defined(__SSE2__) && (defined(__GNUC__) || defined(__clang__))
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i carriage_return = _mm_set1_epi8('\r');
+    const __m128i newline = _mm_set1_epi8('\n');
+    while (end - p >= 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i hits = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, comma), _mm_cmpeq_epi8(chunk, quote)),
+                                    _mm_or_si128(_mm_cmpeq_epi8(chunk, carriage_return), _mm_cmpeq_epi8(chunk, newline)));
+        int mask = _mm_movemask_epi8(hits);
+        if (mask != 0) return p + __builtin_ctz(static_cast<unsigned>(mask));
+        p += 16;
+    }
+#endif
+    while (p < end && *p != ',' && *p != '"' && *p != '\r' && *p != '\n') ++p;
+    return p;
+}
+
+enum class ColumnType { INT, FLOAT, STRING };
+
+ColumnType column_type_from_name(const std::string& name) {
+    if (name == "int") return ColumnType::INT;
+    if (name == "float") return ColumnType::FLOAT;
+    if (name == "string") return ColumnType::STRING;
+    throw std::runtime_error("Unknown column type \"" + name + "\", expected int, float or string");
+}
+
+bool looks_like_int(std::string_view text) {
+    size_t i = (!text.empty() && (text[0] == '-' || text[0] == '+')) ? 1 : 0;
+    if (i == text.size()) return false;
+    for (; i < text.size(); ++i) {
+        if (text[i] < '0' || text[i] > '9') return false;
+    }
+    return true;
+}
+
+bool looks_like_float(std::string_view text) {
+    if (!text.empty() && text[0] == '+') text.remove_prefix(1);
+    float value;
+    auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+    return result.ec == std::errc() && result.ptr == text.data() + text.size();
+}
+
+// Splits a mapped CSV file into typed columns. The first line is the header.
+class CsvReader {
+private:
+    MappedFile file;
+    size_t position = 0;
+    size_t row_number = 1;
+    std::vector<std::string> header;
+    std::vector<ColumnType> types;
+    std::vector<bool> type_fixed;  // set by the schema, inference leaves these alone
+    bool types_inferred = false;
+
+    std::vector<std::string_view> fields;
+    std::deque<std::string> unescaped;  // quoted fields get unescaped in here, reused per row (deque so the views don't move)
+
+    // rows read for inferring the types that a small chunk didn't have room for yet, with their line numbers
+    std::deque<std::vector<std::string>> sampled;
+    std::deque<size_t> sampled_lines;
+
+    static const size_t SAMPLE_ROWS = 1000;
+
+    // false at the end of the file, the views stay valid until the next call
+    bool read_row() {
+        const char* begin = file.data();
+        const char* end = begin + file.size();
+        const char* cur = begin + position;
+
+        // blank lines don't count as rows
+        while (cur < end && (*cur == '\n' || *cur == '\r')) {
+            if (*cur == '\n') ++row_number;
+            ++cur;
+        }
+        if (cur >= end) {
+            position = file.size();
+            return false;
+        }
+
+        fields.clear();
+        while (true) {
+            size_t column = fields.size();
+            if (unescaped.size() <= column) unescaped.emplace_back();
+
+            if (cur < end && *cur == '"') {
+                std::string& text = unescaped[column];
+                text.clear();
+                ++cur;
+                while (true) {
+                    const char* quote = static_cast<const char*>(std::memchr(cur, '"', static_cast<size_t>(end - cur)));
+                    if (!quote) {
+                        throw std::runtime_error("read_csv(): unterminated quoted field on line " + std::to_string(row_number));
+                    }
+                    for (const char* c = cur; c < quote; ++c) {
+                        if (*c == '\n') ++row_number;
+                    }
+                    text.append(cur, quote);
+                    cur = quote + 1;
+                    if (cur < end && *cur == '"') {
+                        text.push_back('"');
+                        ++cur;
+                    } else {
+                        break;
+                    }
+                }
+                if (cur < end && *cur != ',' && *cur != '\r' && *cur != '\n') {
+                    throw std::runtime_error("read_csv(): text after a closing quote on line " + std::to_string(row_number));
+                }
+                fields.emplace_back(text);
+            } else {
+                const char* start = cur;
+                cur = find_csv_special(cur, end);
+                // a quote in the middle of an unquoted field is just a character
+                while (cur < end && *cur == '"') {
+                    cur = find_csv_special(cur + 1, end);
+                }
+                fields.emplace_back(start, static_cast<size_t>(cur - start));
+            }
+
+            if (cur < end && *cur == ',') {
+                ++cur;
+                continue;
+            }
+            if (cur < end && *cur == '\r') ++cur;
+            if (cur < end && *cur == '\n') ++cur;
+            break;
+        }
+
+        position = static_cast<size_t>(cur - begin);
+        ++row_number;
+        return true;
+    }
+
+    Value convert(std::string_view text, size_t column, size_t line) const {
+        switch (types[column]) {
+            case ColumnType::INT: {
+                if (text.empty()) return 0;
+                int value;
+                auto result = std::from_chars(text.data() + (text[0] == '+' ? 1 : 0), text.data() + text.size(), value);
+                if (result.ec == std::errc() && result.ptr == text.data() + text.size()) return value;
+                if (result.ec == std::errc::result_out_of_range && looks_like_int(text)) {
+                    return BigInt::from_string(std::string(text));
+                }
+                break;
+            }
+            case ColumnType::FLOAT: {
+                if (text.empty()) return 0.0f;
+                if (text[0] == '+') text.remove_prefix(1);
+                float value;
+                auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+                if (result.ec == std::errc() && result.ptr == text.data() + text.size()) return value;
+                break;
+            }
+            case ColumnType::STRING:
+                return std::string(text);
+        }
+        throw std::runtime_error("read_csv(): \"" + std::string(text) + "\" in column " + header[column] +
+                                 " on line " + std::to_string(line) + " doesn't match the column type, pass a schema to override it");
+    }
+
+    void check_width() const {
+        if (fields.size() != header.size()) {
+            throw std::runtime_error("read_csv(): line " + std::to_string(row_number - 1) + " has " + std::to_string(fields.size()) +
+                                     " fields, expected " + std::to_string(header.size()));
+        }
+    }
+
+    // narrowest type that fits every non-empty sampled value
+    void infer_types(const std::deque<std::vector<std::string>>& sample) {
+        for (size_t column = 0; column < header.size(); ++column) {
+            if (type_fixed[column]) continue;
+            bool all_int = true;
+            bool all_float = true;
+            for (const auto& row : sample) {
+                const std::string& text = row[column];
+                if (text.empty()) continue;
+                all_int = all_int && looks_like_int(text);
+                all_float = all_float && (all_int || looks_like_float(text));
+                if (!all_float) break;
+            }
+            types[column] = all_int ? ColumnType::INT : (all_float ? ColumnType::FLOAT : ColumnType::STRING);
+        }
+        types_inferred = true;
+    }
+
+public:
+    // schema is either a ROOM of type names in column order, or a keyed ROOM of column name -> type name
+    CsvReader(const std::string& path, const Value* schema) : file(path) {
+        if (!read_row()) {
+            throw std::runtime_error("read_csv(): " + path + " is empty");
+        }
+        for (const auto& field : fields) {
+            // columns come back keyed by name, a second one with the same name would overwrite the first
+            if (std::find(header.begin(), header.end(), field) != header.end()) {
+                throw std::runtime_error("read_csv(): " + path + " has more than one column called " + std::string(field));
+            }
+            header.emplace_back(field);
+        }
+        types.assign(header.size(), ColumnType::STRING);
+        type_fixed.assign(header.size(), false);
+
+        if (!schema) return;
+        if (auto by_position = schema->get_if<ValueArray>()) {
+            if (by_position->size() != header.size()) {
+                throw std::runtime_error("read_csv(): schema has " + std::to_string(by_position->size()) +
+                                         " types but the file has " + std::to_string(header.size()) + " columns");
+            }
+            for (size_t column = 0; column < header.size(); ++column) {
+                const std::string* type = (*by_position)[column].get_if<std::string>();
+                if (!type) {
+                    throw std::runtime_error("read_csv(): schema has to be type names");
+                }
+                types[column] = column_type_from_name(*type);
+                type_fixed[column] = true;
+            }
+        } else if (auto by_name = schema->get_if<ValueMap>()) {
+            for (size_t i = 0; i < by_name->size(); ++i) {
+                const std::string* name = by_name->keys[i].get_if<std::string>();
+                const std::string* type = by_name->values[i].get_if<std::string>();
+                if (!name || !type) {
+                    throw std::runtime_error("read_csv(): schema has to map column names to type names");
+                }
+                auto column = std::find(header.begin(), header.end(), *name);
+                if (column == header.end()) {
+                    throw std::runtime_error("read_csv(): schema names unknown column " + *name);
+                }
+                size_t index = static_cast<size_t>(column - header.begin());
+                types[index] = column_type_from_name(*type);
+                type_fixed[index] = true;
+            }
+        } else {
+            throw std::runtime_error("read_csv(): schema has to be a room of column types");
+        }
+    }
+
+    // up to max_rows rows as a keyed ROOM of columns
+    ValueMap read_rows(size_t max_rows, size_t& rows) {
+        std::vector<ValueVector> columns(header.size());
+        rows = 0;
+
+        // the types come from the first SAMPLE_ROWS rows however small the chunks are, the sampled
+        // rows then go out ahead of the rest of the file
+        if (!types_inferred) {
+            while (sampled.size() < SAMPLE_ROWS && read_row()) {
+                check_width();
+                sampled.emplace_back(fields.begin(), fields.end());
+                sampled_lines.push_back(row_number - 1);
+            }
+            infer_types(sampled);
+        }
+        while (rows < max_rows && !sampled.empty()) {
+            for (size_t column = 0; column < header.size(); ++column) {
+                columns[column].push_back(convert(sampled.front()[column], column, sampled_lines.front()));
+            }
+            sampled.pop_front();
+            sampled_lines.pop_front();
+            ++rows;
+        }
+
+        while (rows < max_rows && read_row()) {
+            check_width();
+            for (size_t column = 0; column < header.size(); ++column) {
+                columns[column].push_back(convert(fields[column], column, row_number - 1));
+            }
+            ++rows;
+        }
+
+        ValueMap result;
+        for (size_t column = 0; column < header.size(); ++column) {
+            result.set(header[column], ValueArray(std::move(columns[column])));
+        }
+        return result;
+    }
+};
+
+// csv_next can be called on one handle from several threads, every chunk goes to one of them
+struct CsvStream {
+    std::mutex mutex;
+    CsvReader reader;
+    size_t chunk_rows;
+
+    CsvStream(const std::string& path, const Value* schema, size_t rows) : reader(path, schema), chunk_rows(rows) {}
+};
+
+void register_csv_functions(FunctionRegistry& registry) {
+    auto streams = std::make_shared<HandleTable<CsvStream>>();
+
+    auto schema_argument = [](const ValueVector& args, size_t index) -> const Value* {
+        return args.size() > index ? &args[index] : nullptr;
+    };
+
+    registry.register_function("read_csv", [schema_argument](const ValueVector& args) -> Value {
+        if (args.empty() || args.size() > 2 || !args[0].get_if<std::string>()) {
+            throw std::runtime_error("read_csv() expects a path and an optional schema");
+        }
+        CsvReader reader(args[0].get<std::string>(), schema_argument(args, 1));
+        size_t rows;
+        return reader.read_rows(SIZE_MAX, rows);
+    });
+
+    registry.register_function("csv_open", [streams, schema_argument](const ValueVector& args) -> Value {
+        if (args.size() < 2 || args.size() > 3 || !args[0].get_if<std::string>() || !args[1].get_if<int>() || args[1].get<int>() <= 0) {
+            throw std::runtime_error("csv_open() expects a path, a positive chunk size and an optional schema");
+        }
+        return streams->add(std::make_shared<CsvStream>(args[0].get<std::string>(), schema_argument(args, 2),
+                                                        static_cast<size_t>(args[1].get<int>())));
+    });
+
+    // the next chunk_rows rows, false once the file is done
+    registry.register_function("csv_next", [streams](const ValueVector& args) -> Value {
+        if (args.size() != 1) {
+            throw std::runtime_error("csv_next() expects exactly 1 argument");
+        }
+        auto stream = streams->get(args[0], "csv_next");
+        std::lock_guard<std::mutex> lock(stream->mutex);
+        size_t rows;
+        ValueMap chunk = stream->reader.read_rows(stream->chunk_rows, rows);
+        if (rows == 0) return false;
+        return chunk;
+    });
+
+    registry.register_function("csv_close", [streams](const ValueVector& args) -> Value {
+        if (args.size() != 1) {
+            throw std::runtime_error("csv_close() expects exactly 1 argument");
+        }
+        streams->remove(args[0], "csv_close");
+        return 0;
+    });
+}
@@ -0,0 +1,157 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <charconv>
+#include <unordered_map>
+#include <stdexcept>
+#include "../parser/functions.hpp"
+#include "../output.hpp"
+
+// A format string broken up once into literal text and {} slots, so formatting
+// is just walking the pieces and appending.
+struct FormatSegment {
+    enum class Kind { TEXT, VALUE, FIXED };
+    Kind kind;
+    std::string text;   // TEXT only
+    int precision = 0;  // FIXED only, the N in {:.Nf}
+};
+
+// {} and {:.Nf} in the output, ints/floats written with to_chars, strings without quotes
+void append_formatted(std::string& out, const Value& value, const FormatSegment& segment) {
+    if (segment.kind == FormatSegment::Kind::FIXED) {
+        double x = value_to_double(value, "format");
+        char buffer[512];
+        auto result = std::to_chars(buffer, buffer + sizeof(buffer), x, std::chars_format::fixed, segment.precision);
+        if (result.ec != std::errc()) {
+            throw std::runtime_error("format() value is too big for {:." + std::to_string(segment.precision) + "f}");
+        }
+        out.append(buffer, result.ptr);
+    } else if (auto i = value.get_if<int>()) {
+        append_int(out, *i);
+    } else if (auto f = value.get_if<float>()) {
+        append_float(out, *f);
+    } else if (auto s = value.get_if<std::string>()) {
+        out += *s;
+    } else {
+        out += value_to_string(value);
+    }
+}
+
+class FormatProgram {
+private:
+    std::vector<FormatSegment> segments;
+    size_t slots = 0;
+
+    void add_text(std::string& text) {
+        if (text.empty()) return;
+        segments.push_back({FormatSegment::Kind::TEXT, std::move(text)});
+        text.clear();
+    }
+
+public:
+    explicit FormatProgram(const std::string& format) {
+        std::string text;
+        for (size_t i = 0; i < format.size(); ++i) {
+            char c = format[i];
+            if ((c == '{' || c == '}') && i + 1 < format.size() && format[i + 1] == c) {
+                text.push_back(c);
+                ++i;
+                continue;
+            }
+            if (c == '}') {
+                throw std::runtime_error("format() found a single '}', use '}}' for a literal one");
+            }
+            if (c != '{') {
+                text.push_back(c);
+                continue;
+            }
+
+            size_t close = format.find('}', i);
+            if (close == std::string::npos) {
+                throw std::runtime_error("format() found a '{' that is never closed");
+            }
+            std::string spec = format.substr(i + 1, close - i - 1);
+            add_text(text);
+            if (spec.empty()) {
+                segments.push_back({FormatSegment::Kind::VALUE, ""});
+            } else {
+                int precision = -1;
+                if (spec.size() >= 4 && spec.compare(0, 2, ":.") == 0 && spec.back() == 'f') {
+                    auto result = std::from_chars(spec.data() + 2, spec.data() + spec.size() - 1, precision);
+                    if (result.ec != std::errc() || result.ptr != spec.data() + spec.size() - 1 || precision > 100) {
+                        precision = -1;
+                    }
+                }
+                if (precision < 0) {
+                    throw std::runtime_error("format() doesn't understand {" + spec + "}, use {} or {:.Nf}");
+                }
+                segments.push_back({FormatSegment::Kind::FIXED, "", precision});
+            }
+            ++slots;
+            i = close;
+        }
+        add_text(text);
+    }
+
+    // args[first...] fill the slots in order
+    void run(std::string& out, const ValueVector& args, size_t first) const {
+        if (args.size() - first != slots) {
+            throw std::runtime_error("format() string has " + std::to_string(slots) + " {} but got " +
+                                     std::to_string(args.size() - first) + " value(s)");
+        }
+        size_t next = first;
+        for (const auto& segment : segments) {
+            if (segment.kind == FormatSegment::Kind::TEXT) {
+                out += segment.text;
+            } else {
+                append_formatted(out, args[next++], segment);
+            }
+        }
+    }
+};
+
+// Format strings are almost always literals, so each distinct one only gets parsed once per thread.
+// Every thread keeps its own cache so pmap() over format() never waits on a lock, and a script
+// that builds format strings on the fly just has the cache start over when it fills up.
+const size_t FORMAT_CACHE_LIMIT = 256;
+
+const FormatProgram& cached_format_program(const std::string& format) {
+    thread_local std::unordered_map<std::string, FormatProgram> programs;
+    auto it = programs.find(format);
+    if (it != programs.end()) return it->second;
+    FormatProgram program(format);
+    if (programs.size() >= FORMAT_CACHE_LIMIT) programs.clear();
+    return programs.emplace(format, std::move(program)).first->second;
+}
+
+void register_format_functions(FunctionRegistry& registry) {
+    registry.register_function("format", [](const ValueVector& args) -> Value {
+        if (args.empty() || !args[0].get_if<std::string>()) {
+            throw std::runtime_error("format() requires a format string as first argument");
+        }
+        std::string out;
+        cached_format_program(args[0].get<std::string>()).run(out, args, 1);
+        return out;
+    });
+
+    // replaces the basic print: print(value) works like before, print("fmt", ...) formats
+    // straight into the line buffer. No std::endl, program_output() decides when it hits stdout.
+    registry.register_function("print", [](const ValueVector& args) -> Value {
+        if (args.empty()) {
+            throw std::runtime_error("print() expects at least 1 argument");
+        }
+        thread_local std::string line;
+        line.clear();
+        if (args.size() == 1) {
+            line = value_to_string(args[0]);
+        } else {
+            if (!args[0].get_if<std::string>()) {
+                throw std::runtime_error("print() with more than 1 argument requires a format string first");
+            }
+            cached_format_program(args[0].get<std::string>()).run(line, args, 1);
+        }
+        line.push_back('\n');
+        program_output().write(line);
+        return 0;
+    });
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <memory>
+#include <mutex>
+#include <string>
+#include <stdexcept>
+#include <unordered_map>
+#include "../parser/functions.hpp"
+
+// Scripts only see an int for things like open files, this maps the int back to the object.
+// Locked so builtins can be called from more than one thread.
+template<typename T>
+class HandleTable {
+private:
+    std::mutex mutex;
+    std::unordered_map<int, std::shared_ptr<T>> entries;
+    int next_handle = 1;
+
+public:
+    int add(std::shared_ptr<T> entry) {
+        std::lock_guard<std::mutex> lock(mutex);
+        int handle = next_handle++;
+        entries.emplace(handle, std::move(entry));
+        return handle;
+    }
+
+    std::shared_ptr<T> get(const Value& handle, const std::string& function_name) {
+        if (!handle.get_if<int>()) {
+            throw std::runtime_error(function_name + "() requires a handle as first argument");
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find(handle.get<int>());
+        if (it == entries.end()) {
+            throw std::runtime_error(function_name + "() got an invalid or closed handle");
+        }
+        return it->second;
+    }
+
+    // like get(), but a handle that was handed out and has since been removed gives back null
+    std::shared_ptr<T> find(const Value& handle, const std::string& function_name) {
+        if (!handle.get_if<int>()) {
+            throw std::runtime_error(function_name + "() requires a handle as first argument");
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find(handle.get<int>());
+        if (it != entries.end()) return it->second;
+        if (handle.get<int>() <= 0 || handle.get<int>() >= next_handle) {
+            throw std::runtime_error(function_name + "() got an invalid or closed handle");
+        }
+        return nullptr;
+    }
+
+    void remove(const Value& handle, const std::string& function_name) {
+        if (!handle.get_if<int>()) {
+            throw std::runtime_error(function_name + "() requires a handle as first argument");
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        if (entries.erase(handle.get<int>()) == 0) {
+            throw std::runtime_error(function_name + "() got an invalid or closed handle");
+        }
+    }
+
+    // remove() for when someone else may have got there first
+    void discard(const Value& handle) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (auto h = handle.get_if<int>()) entries.erase(*h);
+    }
+
+    size_t size() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return entries.size();
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex);
+        entries.clear();
+    }
+};
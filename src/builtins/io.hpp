@@ -0,0 +1,176 @@
+#pragma once
+#include <string>
+#include <memory>
+#include <cstring>
+#include <cerrno>
+#include <mutex>
+#include <stdexcept>
+#include "../parser/functions.hpp"
+#include "handles.hpp"
+
+#ifdef _WIN32
+#include "../win32.hpp"
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+// Read-only view of a whole file, mapped (mmap, or a file mapping on Windows) so big files cost
+// address space, not memory.
+class MappedFile {
+private:
+    const char* bytes = nullptr;
+    size_t length = 0;
+
+public:
+    MappedFile(const std::string& path) {
+#ifdef _WIN32
+        void* file = CreateFileA(path.c_str(), WIN32_GENERIC_READ, WIN32_FILE_SHARE_READ, nullptr, WIN32_OPEN_EXISTING,
+                                 WIN32_FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == WIN32_INVALID_HANDLE) {
+            throw std::runtime_error("Failed to open file: " + path);
+        }
+        unsigned long size_high = 0;
+        unsigned long size_low = GetFileSize(file, &size_high);
+        if (size_low == WIN32_INVALID_FILE_SIZE && GetLastError() != WIN32_NO_ERROR) {
+            CloseHandle(file);
+            throw std::runtime_error("Failed to stat file: " + path);
+        }
+        length = static_cast<size_t>((static_cast<uint64_t>(size_high) << 32) | size_low);
+        if (length > 0) {
+            void* mapping = CreateFileMappingA(file, nullptr, WIN32_PAGE_READONLY, 0, 0, nullptr);
+            void* view = mapping ? MapViewOfFile(mapping, WIN32_FILE_MAP_READ, 0, 0, 0) : nullptr;
+            if (mapping) CloseHandle(mapping);  // the view keeps the mapping alive
+            if (!view) {
+                CloseHandle(file);
+                throw std::runtime_error("Failed to map file: " + path);
+            }
+            bytes = static_cast<const char*>(view);
+        }
+        CloseHandle(file);
+#else
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Failed to open file: " + path + " (" + std::strerror(errno) + ")");
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0) {
+            close(fd);
+            throw std::runtime_error("Failed to stat file: " + path);
+        }
+        length = static_cast<size_t>(info.st_size);
+        if (length > 0) {
+            void* mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapping == MAP_FAILED) {
+                close(fd);
+                throw std::runtime_error("Failed to map file: " + path + " (" + std::strerror(errno) + ")");
+            }
+            madvise(mapping, length, MADV_SEQUENTIAL);
+            bytes = static_cast<const char*>(mapping);
+        }
+        close(fd);  // the mapping keeps the file alive
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+#ifdef _WIN32
+        if (bytes) UnmapViewOfFile(bytes);
+#else
+        if (bytes) munmap(const_cast<char*>(bytes), length);
+#endif
+    }
+
+    const char* data() const { return bytes; }
+    size_t size() const { return length; }
+
+    // tells the kernel we're done with everything before offset, keeps memory flat on long sequential reads
+    void release_before(size_t offset) {
+#ifndef _WIN32
+        size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        size_t end = offset / page * page;
+        if (bytes && end > 0) {
+            madvise(const_cast<char*>(bytes), end, MADV_DONTNEED);
+        }
+#else
+        (void)offset;  // mapped file pages are clean, Windows drops them from the working set by itself
+#endif
+    }
+};
+
+// One handle can be read from several threads (pfor bodies, tasks, isolates), each line goes to one of them
+class LineReader {
+private:
+    MappedFile file;
+    std::mutex mutex;
+    size_t position = 0;
+    size_t released = 0;
+
+    static const size_t RELEASE_CHUNK = 64 * 1024 * 1024;
+
+public:
+    LineReader(const std::string& path) : file(path) {}
+
+    // false once there's nothing left, the '\n' (and a '\r' before it) isn't part of the line
+    bool next(std::string& line) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (position >= file.size()) return false;
+
+        const char* start = file.data() + position;
+        size_t remaining = file.size() - position;
+        const char* newline = static_cast<const char*>(std::memchr(start, '\n', remaining));
+        size_t line_length = newline ? static_cast<size_t>(newline - start) : remaining;
+
+        position += newline ? line_length + 1 : line_length;
+        if (line_length > 0 && start[line_length - 1] == '\r') --line_length;
+        line.assign(start, line_length);
+
+        if (position - released >= RELEASE_CHUNK) {
+            file.release_before(position);
+            released = position;
+        }
+        return true;
+    }
+};
+
+void register_io_functions(FunctionRegistry& registry) {
+    auto readers = std::make_shared<HandleTable<LineReader>>();
+
+    registry.register_function("open_lines", [readers](const ValueVector& args) -> Value {
+        if (args.size() != 1 || !args[0].get_if<std::string>()) {
+            throw std::runtime_error("open_lines() expects exactly 1 path argument");
+        }
+        return readers->add(std::make_shared<LineReader>(args[0].get<std::string>()));
+    });
+
+    registry.register_function("next_line", [readers](const ValueVector& args) -> Value {
+        if (args.size() != 1) {
+            throw std::runtime_error("next_line() expects exactly 1 argument");
+        }
+        std::string line;
+        if (!readers->get(args[0], "next_line")->next(line)) {
+            return false;
+        }
+        return line;
+    });
+
+    registry.register_function("close_lines", [readers](const ValueVector& args) -> Value {
+        if (args.size() != 1) {
+            throw std::runtime_error("close_lines() expects exactly 1 argument");
+        }
+        readers->remove(args[0], "close_lines");
+        return 0;
+    });
+
+    registry.register_function("read_all", [](const ValueVector& args) -> Value {
+        if (args.size() != 1 || !args[0].get_if<std::string>()) {
+            throw std::runtime_error("read_all() expects exactly 1 path argument");
+        }
+        MappedFile file(args[0].get<std::string>());
+        return std::string(file.data() ? file.data() : "", file.size());
+    });
+}
@@ -0,0 +1,383 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <charconv>
+#include <stdexcept>
+#include "../parser/functions.hpp"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/*
+    JSON goes through two stages, like simdjson does it:
+
+    1. find every structural character ({ } [ ] : ,) and every string quote outside
+       of strings, 16 bytes at a time, into a flat index
+    2. walk that index to build the Values, so strings and containers never have to
+       be scanned byte by byte again
+
+    Arrays become ROOMs, objects become keyed ROOMs, null becomes false
+    (there's no null in the language).
+*/
+
+bool is_json_whitespace(char c) {
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+bool is_json_structural(char c) {
+    return c == '{' || c == '}' || c == '[' || c == ']' || c == ':' || c == ',';
+}
+
+void build_json_index(const char* text, size_t length, std::vector<uint32_t>& index) {
+    if (length > UINT32_MAX) {
+        throw std::runtime_error("json_parse() only handles documents up to 4 GB");
+    }
+
+    bool in_string = false;
+    size_t escaped = SIZE_MAX;  // the character after a backslash doesn't count
+
+    auto visit = [&](size_t pos) {
+        char c = text[pos];
+        if (in_string) {
+            if (pos == escaped) return;
+            if (c == '\\') {
+                escaped = pos + 1;
+            } else if (c == '"') {
+                in_string = false;
+                index.push_back(static_cast<uint32_t>(pos));
+            }
+        } else if (c == '"') {
+            in_string = true;
+            index.push_back(static_cast<uint32_t>(pos));
+        } else if (is_json_structural(c)) {
+            index.push_back(static_cast<uint32_t>(pos));
+        }
+    };
+
+    size_t pos = 0;
+#if defined(__SSE2__) && (defined(__GNUC__) || defined(__clang__))
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i open_curly = _mm_set1_epi8('{');
+    const __m128i close_curly = _mm_set1_epi8('}');
+    const __m128i open_brack = _mm_set1_epi8('[');
+    const __m128i close_brack = _mm_set1_epi8(']');
+    const __m128i colon = _mm_set1_epi8(':');
+    const __m128i comma = _mm_set1_epi8(',');
+    for (; pos + 16 <= length; pos += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + pos));
+        __m128i hits = _mm_or_si128(
+            _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+                         _mm_or_si128(_mm_cmpeq_epi8(chunk, open_curly), _mm_cmpeq_epi8(chunk, close_curly))),
+            _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, open_brack), _mm_cmpeq_epi8(chunk, close_brack)),
+                         _mm_or_si128(_mm_cmpeq_epi8(chunk, colon), _mm_cmpeq_epi8(chunk, comma))));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(hits));
+        while (mask != 0) {
+            visit(pos + static_cast<size_t>(__builtin_ctz(mask)));
+            mask &= mask - 1;
+        }
+    }
+#endif
+    for (; pos < length; ++pos) {
+        char c = text[pos];
+        if (c == '"' || c == '\\' || is_json_structural(c)) visit(pos);
+    }
+
+    if (in_string) {
+        throw std::runtime_error("json_parse(): unterminated string");
+    }
+}
+
+class JsonParser {
+private:
+    const char* text;
+    size_t length;
+    const std::vector<uint32_t>& index;
+    size_t next = 0;  // next entry in the index
+    size_t pos = 0;   // byte position
+
+    static const int MAX_DEPTH = 1024;
+
+    [[noreturn]] void fail(const std::string& message) const {
+        throw std::runtime_error("json_parse(): " + message + " at byte " + std::to_string(pos));
+    }
+
+    void skip_whitespace() {
+        while (pos < length && is_json_whitespace(text[pos])) ++pos;
+    }
+
+    // the next indexed character has to come right after some whitespace
+    char take_structural() {
+        skip_whitespace();
+        if (next >= index.size() || index[next] != pos) {
+            if (pos >= length) fail("unexpected end of input");
+            fail(std::string("unexpected character '") + text[pos] + "'");
+        }
+        ++next;
+        return text[pos++];
+    }
+
+    char peek() {
+        skip_whitespace();
+        if (pos >= length) fail("unexpected end of input");
+        return text[pos];
+    }
+
+    static void append_utf8(std::string& out, uint32_t code_point) {
+        if (code_point < 0x80) {
+            out.push_back(static_cast<char>(code_point));
+        } else if (code_point < 0x800) {
+            out.push_back(static_cast<char>(0xC0 | (code_point >> 6)));
+            out.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+        } else if (code_point < 0x10000) {
+            out.push_back(static_cast<char>(0xE0 | (code_point >> 12)));
+            out.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+        } else {
+            out.push_back(static_cast<char>(0xF0 | (code_point >> 18)));
+            out.push_back(static_cast<char>(0x80 | ((code_point >> 12) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+        }
+    }
+
+    uint32_t read_hex4(size_t at) const {
+        if (at + 4 > length) {
+            throw std::runtime_error("json_parse(): truncated \\u escape");
+        }
+        uint32_t value = 0;
+        auto result = std::from_chars(text + at, text + at + 4, value, 16);
+        if (result.ptr != text + at + 4) {
+            throw std::runtime_error("json_parse(): invalid \\u escape");
+        }
+        return value;
+    }
+
+    std::string parse_string() {
+        // both quotes are in the index, so the end is already known
+        take_structural();
+        size_t begin = pos;
+        size_t end = index[next++];
+        pos = end + 1;
+
+        const char* body = text + begin;
+        size_t body_length = end - begin;
+        if (!std::memchr(body, '\\', body_length)) {
+            return std::string(body, body_length);
+        }
+
+        std::string out;
+        out.reserve(body_length);
+        for (size_t i = begin; i < end; ++i) {
+            if (text[i] != '\\') {
+                out.push_back(text[i]);
+                continue;
+            }
+            char escape = text[++i];
+            switch (escape) {
+                case '"': out.push_back('"'); break;
+                case '\\': out.push_back('\\'); break;
+                case '/': out.push_back('/'); break;
+                case 'b': out.push_back('\b'); break;
+                case 'f': out.push_back('\f'); break;
+                case 'n': out.push_back('\n'); break;
+                case 'r': out.push_back('\r'); break;
+                case 't': out.push_back('\t'); break;
+                case 'u': {
+                    uint32_t code_point = read_hex4(i + 1);
+                    i += 4;
+                    if (code_point >= 0xD800 && code_point < 0xDC00 && i + 6 < end && text[i + 1] == '\\' && text[i + 2] == 'u') {
+                        uint32_t low = read_hex4(i + 3);
+                        if (low >= 0xDC00 && low < 0xE000) {
+                            code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+                            i += 6;
+                        }
+                    }
+                    append_utf8(out, code_point);
+                    break;
+                }
+                default:
+                    throw std::runtime_error(std::string("json_parse(): invalid escape \\") + escape);
+            }
+        }
+        return out;
+    }
+
+    Value parse_atom() {
+        size_t begin = pos;
+        while (pos < length && !is_json_whitespace(text[pos]) && !is_json_structural(text[pos]) && text[pos] != '"') ++pos;
+        std::string_view atom(text + begin, pos - begin);
+
+        if (atom == "true") return true;
+        if (atom == "false" || atom == "null") return false;
+        if (atom.empty() || !(atom[0] == '-' || (atom[0] >= '0' && atom[0] <= '9'))) {
+            pos = begin;
+            fail("unexpected token '" + std::string(atom) + "'");
+        }
+
+        if (atom.find_first_of(".eE") == std::string_view::npos) {
+            int value;
+            auto result = std::from_chars(atom.data(), atom.data() + atom.size(), value);
+            if (result.ec == std::errc() && result.ptr == atom.data() + atom.size()) return value;
+            if (result.ec == std::errc::result_out_of_range) return BigInt::from_string(std::string(atom));
+        } else {
+            float value;
+            auto result = std::from_chars(atom.data(), atom.data() + atom.size(), value);
+            if (result.ec == std::errc() && result.ptr == atom.data() + atom.size()) return value;
+        }
+        pos = begin;
+        fail("invalid number '" + std::string(atom) + "'");
+    }
+
+    Value parse_value(int depth) {
+        if (depth > MAX_DEPTH) fail("nesting too deep");
+
+        char c = peek();
+        if (c == '"') {
+            return parse_string();
+        }
+        if (c == '[') {
+            take_structural();
+            ValueVector elements;
+            if (peek() == ']') {
+                take_structural();
+                return ValueArray(std::move(elements));
+            }
+            while (true) {
+                elements.push_back(parse_value(depth + 1));
+                char separator = take_structural();
+                if (separator == ']') break;
+                if (separator != ',') fail("expected ',' or ']'");
+            }
+            return ValueArray(std::move(elements));
+        }
+        if (c == '{') {
+            take_structural();
+            ValueMap object;
+            if (peek() == '}') {
+                take_structural();
+                return object;
+            }
+            while (true) {
+                if (peek() != '"') fail("expected a string key");
+                std::string key = parse_string();
+                if (take_structural() != ':') fail("expected ':'");
+                object.set(std::move(key), parse_value(depth + 1));
+                char separator = take_structural();
+                if (separator == '}') break;
+                if (separator != ',') fail("expected ',' or '}'");
+            }
+            return object;
+        }
+        if (is_json_structural(c)) {
+            fail(std::string("unexpected '") + c + "'");
+        }
+        return parse_atom();
+    }
+
+public:
+    JsonParser(const char* text, size_t length, const std::vector<uint32_t>& index)
+        : text(text), length(length), index(index) {}
+
+    Value parse_document() {
+        Value result = parse_value(0);
+        skip_whitespace();
+        if (pos != length || next != index.size()) {
+            fail("unexpected data after the document");
+        }
+        return result;
+    }
+};
+
+Value json_parse(const std::string& text) {
+    std::vector<uint32_t> index;
+    index.reserve(text.size() / 8);
+    build_json_index(text.data(), text.size(), index);
+    return JsonParser(text.data(), text.size(), index).parse_document();
+}
+
+void append_json_string(std::string& out, const std::string& value) {
+    static const char hex[] = "0123456789abcdef";
+    out.push_back('"');
+    size_t run_start = 0;
+    for (size_t i = 0; i < value.size(); ++i) {
+        unsigned char c = static_cast<unsigned char>(value[i]);
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+
+        out.append(value, run_start, i - run_start);
+        run_start = i + 1;
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            case '\b': out += "\\b"; break;
+            case '\f': out += "\\f"; break;
+            default:
+                out += "\\u00";
+                out.push_back(hex[c >> 4]);
+                out.push_back(hex[c & 0xF]);
+        }
+    }
+    out.append(value, run_start, value.size() - run_start);
+    out.push_back('"');
+}
+
+// writes into one growing buffer instead of concatenating strings like value_to_string does
+void append_json(std::string& out, const Value& val) {
+    std::visit([&out](const auto& v) {
+        using T = std::decay_t<decltype(v)>;
+        if constexpr (std::is_same_v<T, bool>) {
+            out += v ? "true" : "false";
+        } else if constexpr (std::is_same_v<T, int>) {
+            append_int(out, v);
+        } else if constexpr (std::is_same_v<T, float>) {
+            if (std::isfinite(v)) append_float(out, v);
+            else out += "null";
+        } else if constexpr (std::is_same_v<T, std::string>) {
+            append_json_string(out, v);
+        } else if constexpr (std::is_same_v<T, BigInt>) {
+            out += v.to_string();
+        } else if constexpr (std::is_same_v<T, ValueArray>) {
+            out.push_back('[');
+            for (size_t i = 0; i < v.size(); ++i) {
+                if (i > 0) out.push_back(',');
+                append_json(out, v[i]);
+            }
+            out.push_back(']');
+        } else if constexpr (std::is_same_v<T, ValueMap>) {
+            out.push_back('{');
+            for (size_t i = 0; i < v.size(); ++i) {
+                if (i > 0) out.push_back(',');
+                // JSON keys are always strings
+                if (auto key = v.keys[i].template get_if<std::string>()) append_json_string(out, *key);
+                else append_json_string(out, value_to_string(v.keys[i]));
+                out.push_back(':');
+                append_json(out, v.values[i]);
+            }
+            out.push_back('}');
+        }
+    }, val.data);
+}
+
+void register_json_functions(FunctionRegistry& registry) {
+    registry.register_function("json_parse", [](const ValueVector& args) -> Value {
+        if (args.size() != 1 || !args[0].get_if<std::string>()) {
+            throw std::runtime_error("json_parse() expects exactly 1 string argument");
+        }
+        return json_parse(args[0].get<std::string>());
+    });
+
+    registry.register_function("json_stringify", [](const ValueVector& args) -> Value {
+        if (args.size() != 1) {
+            throw std::runtime_error("json_stringify() expects exactly 1 argument");
+        }
+        std::string out;
+        append_json(out, args[0]);
+        return out;
+    });
+}
@@ -0,0 +1,320 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <stdexcept>
+#include "../parser/functions.hpp"
+#include "io.hpp"
+
+/*
+    Binary format used by save()/load() (and anything else that needs to dump Values):
+
+    header  "AST*" | u16 version | u16 flags | u64 payload size | u64 checksum
+    payload one encoded value
+
+    Every value starts with a one byte tag. ROOMs that are all ints or all floats are
+    written as packed columns (count + raw 4 byte values) instead of one tag per element,
+    which is most of what big datasets look like. Numbers are in host byte order.
+*/
+
+const char PERSIST_MAGIC[4] = {'A', 'S', 'T', '*'};
+const uint16_t PERSIST_VERSION = 1;
+const uint16_t PERSIST_FLAG_CHECKSUM = 1;
+const size_t PERSIST_HEADER_SIZE = 24;
+
+enum PersistTag : uint8_t {
+    TAG_INT = 0, TAG_FLOAT = 1, TAG_STRING = 2, TAG_BOOL = 3, TAG_ROOM = 4,
+    TAG_BIGINT = 5, TAG_MAP = 6, TAG_INT_COLUMN = 7, TAG_FLOAT_COLUMN = 8
+};
+
+// FNV-1a, 8 bytes at a time so it isn't the slow part of loading
+uint64_t persist_checksum(const char* data, size_t length) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, data + i, 8);
+        hash = (hash ^ word) * 0x100000001b3ULL;
+    }
+    for (; i < length; ++i) {
+        hash = (hash ^ static_cast<unsigned char>(data[i])) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+template<typename T>
+void append_raw(std::string& out, const T& value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+void encode_value(std::string& out, const Value& val) {
+    std::visit([&out](const auto& v) {
+        using T = std::decay_t<decltype(v)>;
+        if constexpr (std::is_same_v<T, int>) {
+            out.push_back(static_cast<char>(TAG_INT));
+            append_raw(out, static_cast<int32_t>(v));
+        } else if constexpr (std::is_same_v<T, float>) {
+            out.push_back(static_cast<char>(TAG_FLOAT));
+            append_raw(out, v);
+        } else if constexpr (std::is_same_v<T, std::string>) {
+            out.push_back(static_cast<char>(TAG_STRING));
+            append_raw(out, static_cast<uint64_t>(v.size()));
+            out += v;
+        } else if constexpr (std::is_same_v<T, bool>) {
+            out.push_back(static_cast<char>(TAG_BOOL));
+            out.push_back(v ? 1 : 0);
+        } else if constexpr (std::is_same_v<T, BigInt>) {
+            std::string digits = v.to_string();
+            out.push_back(static_cast<char>(TAG_BIGINT));
+            append_raw(out, static_cast<uint64_t>(digits.size()));
+            out += digits;
+        } else if constexpr (std::is_same_v<T, ValueMap>) {
+            out.push_back(static_cast<char>(TAG_MAP));
+            append_raw(out, static_cast<uint64_t>(v.size()));
+            for (size_t i = 0; i < v.size(); ++i) {
+                encode_value(out, v.keys[i]);
+                encode_value(out, v.values[i]);
+            }
+        } else if constexpr (std::is_same_v<T, ValueArray>) {
+            bool all_ints = !v.empty();
+            bool all_floats = !v.empty();
+            for (const auto& element : v) {
+                all_ints = all_ints && element.template holds<int>();
+                all_floats = all_floats && element.template holds<float>();
+                if (!all_ints && !all_floats) break;
+            }
+
+            if (all_ints || all_floats) {
+                out.push_back(static_cast<char>(all_ints ? TAG_INT_COLUMN : TAG_FLOAT_COLUMN));
+                append_raw(out, static_cast<uint64_t>(v.size()));
+                size_t start = out.size();
+                out.resize(start + v.size() * 4);
+                char* column = &out[start];
+                for (size_t i = 0; i < v.size(); ++i) {
+                    if (all_ints) {
+                        int32_t x = v[i].template get<int>();
+                        std::memcpy(column + i * 4, &x, 4);
+                    } else {
+                        float x = v[i].template get<float>();
+                        std::memcpy(column + i * 4, &x, 4);
+                    }
+                }
+            } else {
+                out.push_back(static_cast<char>(TAG_ROOM));
+                append_raw(out, static_cast<uint64_t>(v.size()));
+                for (const auto& element : v) {
+                    encode_value(out, element);
+                }
+            }
+        }
+    }, val.data);
+}
+
+class PersistReader {
+private:
+    const char* data;
+    size_t length;
+    size_t pos = 0;
+
+    static const int MAX_DEPTH = 10000;
+
+    void need(size_t bytes) const {
+        if (bytes > length - pos) {
+            throw std::runtime_error("load(): data is truncated or corrupt");
+        }
+    }
+
+    template<typename T>
+    T read() {
+        need(sizeof(T));
+        T value;
+        std::memcpy(&value, data + pos, sizeof(T));
+        pos += sizeof(T);
+        return value;
+    }
+
+    std::string read_string() {
+        uint64_t size = read<uint64_t>();
+        need(size);
+        std::string value(data + pos, size);
+        pos += size;
+        return value;
+    }
+
+    Value read_value(int depth) {
+        if (depth > MAX_DEPTH) {
+            throw std::runtime_error("load(): data is nested too deep");
+        }
+        uint8_t tag = read<uint8_t>();
+        switch (tag) {
+            case TAG_INT: return static_cast<int>(read<int32_t>());
+            case TAG_FLOAT: return read<float>();
+            case TAG_STRING: return read_string();
+            case TAG_BOOL: return read<uint8_t>() != 0;
+            case TAG_BIGINT: return normalize_integer(BigInt::from_string(read_string()));
+            case TAG_MAP: {
+                uint64_t count = read<uint64_t>();
+                ValueMap map;
+                for (uint64_t i = 0; i < count; ++i) {
+                    Value key = read_value(depth + 1);
+                    map.set(std::move(key), read_value(depth + 1));
+                }
+                return map;
+            }
+            case TAG_ROOM: {
+                uint64_t count = read<uint64_t>();
+                need(count);  // every element is at least a tag byte
+                ValueVector elements;
+                elements.reserve(count);
+                for (uint64_t i = 0; i < count; ++i) {
+                    elements.push_back(read_value(depth + 1));
+                }
+                return ValueArray(std::move(elements));
+            }
+            case TAG_INT_COLUMN:
+            case TAG_FLOAT_COLUMN: {
+                uint64_t count = read<uint64_t>();
+                if (count > (length - pos) / 4) need(SIZE_MAX);
+                const char* column = data + pos;
+                ValueVector elements(count);
+                if (tag == TAG_INT_COLUMN) {
+                    for (uint64_t i = 0; i < count; ++i) {
+                        int32_t x;
+                        std::memcpy(&x, column + i * 4, 4);
+                        elements[i].data = static_cast<int>(x);
+                    }
+                } else {
+                    for (uint64_t i = 0; i < count; ++i) {
+                        float x;
+                        std::memcpy(&x, column + i * 4, 4);
+                        elements[i].data = x;
+                    }
+                }
+                pos += count * 4;
+                return ValueArray(std::move(elements));
+            }
+            default:
+                throw std::runtime_error("load(): unknown value tag " + std::to_string(tag));
+        }
+    }
+
+public:
+    PersistReader(const char* data, size_t length) : data(data), length(length) {}
+
+    Value read_document() {
+        Value result = read_value(0);
+        if (pos != length) {
+            throw std::runtime_error("load(): unexpected data after the value");
+        }
+        return result;
+    }
+};
+
+// fills in the header in front of an encoded payload
+void finish_document(std::string& out, bool checksum) {
+    uint64_t payload_size = out.size() - PERSIST_HEADER_SIZE;
+    uint16_t flags = checksum ? PERSIST_FLAG_CHECKSUM : 0;
+    uint64_t hash = checksum ? persist_checksum(out.data() + PERSIST_HEADER_SIZE, payload_size) : 0;
+
+    std::memcpy(&out[0], PERSIST_MAGIC, 4);
+    std::memcpy(&out[4], &PERSIST_VERSION, 2);
+    std::memcpy(&out[6], &flags, 2);
+    std::memcpy(&out[8], &payload_size, 8);
+    std::memcpy(&out[16], &hash, 8);
+}
+
+// header + payload, ready to be written somewhere
+std::string encode_document(const Value& val, bool checksum) {
+    std::string out(PERSIST_HEADER_SIZE, '\0');
+    encode_value(out, val);
+    finish_document(out, checksum);
+    return out;
+}
+
+// checkpoint() files are {"statements": n, "next": i, "variables": {name: value, ...}}.
+// The variables are encoded straight from the table so big globals don't get copied first.
+std::string encode_checkpoint(size_t statement_count, size_t next_statement,
+                              const std::unordered_map<std::string, Value>& variables) {
+    std::string out(PERSIST_HEADER_SIZE, '\0');
+    out.push_back(static_cast<char>(TAG_MAP));
+    append_raw(out, static_cast<uint64_t>(3));
+    encode_value(out, std::string("statements"));
+    encode_value(out, normalize_integer(BigInt(static_cast<int64_t>(statement_count))));
+    encode_value(out, std::string("next"));
+    encode_value(out, normalize_integer(BigInt(static_cast<int64_t>(next_statement))));
+    encode_value(out, std::string("variables"));
+    out.push_back(static_cast<char>(TAG_MAP));
+    append_raw(out, static_cast<uint64_t>(variables.size()));
+    for (const auto& [name, value] : variables) {
+        encode_value(out, name);
+        encode_value(out, value);
+    }
+    finish_document(out, true);
+    return out;
+}
+
+Value decode_document(const char* data, size_t length) {
+    if (length < PERSIST_HEADER_SIZE || std::memcmp(data, PERSIST_MAGIC, 4) != 0) {
+        throw std::runtime_error("load(): not a saved asterisk value");
+    }
+    uint16_t version, flags;
+    uint64_t payload_size, hash;
+    std::memcpy(&version, data + 4, 2);
+    std::memcpy(&flags, data + 6, 2);
+    std::memcpy(&payload_size, data + 8, 8);
+    std::memcpy(&hash, data + 16, 8);
+
+    if (version != PERSIST_VERSION) {
+        throw std::runtime_error("load(): unsupported format version " + std::to_string(version));
+    }
+    if (payload_size != length - PERSIST_HEADER_SIZE) {
+        throw std::runtime_error("load(): data is truncated or corrupt");
+    }
+    const char* payload = data + PERSIST_HEADER_SIZE;
+    if ((flags & PERSIST_FLAG_CHECKSUM) && persist_checksum(payload, payload_size) != hash) {
+        throw std::runtime_error("load(): checksum mismatch, the data is corrupt");
+    }
+    return PersistReader(payload, payload_size).read_document();
+}
+
+void write_document(const std::string& path, const std::string& document, const std::string& function_name) {
+    FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file) {
+        throw std::runtime_error(function_name + "(): failed to open " + path);
+    }
+    size_t written = std::fwrite(document.data(), 1, document.size(), file);
+    bool closed = std::fclose(file) == 0;
+    if (written != document.size() || !closed) {
+        throw std::runtime_error(function_name + "(): failed to write " + path);
+    }
+}
+
+void save_document(const std::string& path, const Value& val, bool checksum, const std::string& function_name) {
+    write_document(path, encode_document(val, checksum), function_name);
+}
+
+Value load_document(const std::string& path) {
+    MappedFile file(path);
+    return decode_document(file.data(), file.size());
+}
+
+void register_persist_functions(FunctionRegistry& registry) {
+    registry.register_function("save", [](const ValueVector& args) -> Value {
+        if (args.size() < 2 || args.size() > 3 || !args[1].get_if<std::string>()) {
+            throw std::runtime_error("save() expects a value, a path and an optional checksum flag");
+        }
+        bool checksum = args.size() == 3 && args[2].get_if<bool>() && args[2].get<bool>();
+        save_document(args[1].get<std::string>(), args[0], checksum, "save");
+        return 0;
+    });
+
+    registry.register_function("load", [](const ValueVector& args) -> Value {
+        if (args.size() != 1 || !args[0].get_if<std::string>()) {
+            throw std::runtime_error("load() expects exactly 1 path argument");
+        }
+        return load_document(args[0].get<std::string>());
+    });
+}
@@ -0,0 +1,124 @@
+#pragma once
+#include <cstdint>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include "../parser/functions.hpp"
+
+// xoshiro256** (Blackman & Vigna), seeded through splitmix64 like the reference code
+class RandomGenerator {
+private:
+    uint64_t state[4];
+
+    static uint64_t rotl(uint64_t x, int k) {
+        return (x << k) | (x >> (64 - k));
+    }
+
+public:
+    RandomGenerator(uint64_t seed_value) {
+        seed(seed_value);
+    }
+
+    void seed(uint64_t seed_value) {
+        for (auto& word : state) {
+            seed_value += 0x9e3779b97f4a7c15ULL;
+            uint64_t z = seed_value;
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            word = z ^ (z >> 31);
+        }
+    }
+
+    uint64_t next() {
+        const uint64_t result = rotl(state[1] * 5, 7) * 9;
+        const uint64_t t = state[1] << 17;
+
+        state[2] ^= state[0];
+        state[3] ^= state[1];
+        state[1] ^= state[2];
+        state[0] ^= state[3];
+        state[2] ^= t;
+        state[3] = rotl(state[3], 45);
+
+        return result;
+    }
+
+    // top 24 bits, so every float in [0, 1) is equally likely
+    float next_float() {
+        return static_cast<float>(next() >> 40) * (1.0f / 16777216.0f);
+    }
+
+    // unbiased value in [0, range), range > 0
+    uint64_t next_below(uint64_t range) {
+        uint64_t threshold = (0 - range) % range;
+        while (true) {
+            uint64_t x = next();
+            if (x >= threshold) return x % range;
+        }
+    }
+};
+
+void register_random_functions(FunctionRegistry& registry) {
+    auto generator = std::make_shared<RandomGenerator>(
+        static_cast<uint64_t>(std::chrono::high_resolution_clock::now().time_since_epoch().count()));
+    // one stream for the whole script, pfor threads take turns
+    auto mutex = std::make_shared<std::mutex>();
+
+    registry.register_function("seed", [generator, mutex](const ValueVector& args) -> Value {
+        if (args.size() != 1 || !args[0].get_if<int>()) {
+            throw std::runtime_error("seed() expects exactly 1 integer argument");
+        }
+        std::lock_guard<std::mutex> lock(*mutex);
+        generator->seed(static_cast<uint64_t>(static_cast<int64_t>(args[0].get<int>())));
+        return 0;
+    });
+
+    registry.register_function("rand", [generator, mutex](const ValueVector& args) -> Value {
+        if (!args.empty()) {
+            throw std::runtime_error("rand() expects no arguments");
+        }
+        std::lock_guard<std::mutex> lock(*mutex);
+        return generator->next_float();
+    });
+
+    registry.register_function("rand_int", [generator, mutex](const ValueVector& args) -> Value {
+        if (args.size() != 2 || !args[0].get_if<int>() || !args[1].get_if<int>()) {
+            throw std::runtime_error("rand_int() expects exactly 2 integer arguments");
+        }
+        int64_t lo = args[0].get<int>();
+        int64_t hi = args[1].get<int>();
+        if (lo > hi) {
+            throw std::runtime_error("rand_int() requires lo <= hi");
+        }
+        uint64_t range = static_cast<uint64_t>(hi - lo) + 1;
+        std::lock_guard<std::mutex> lock(*mutex);
+        return static_cast<int>(lo + static_cast<int64_t>(generator->next_below(range)));
+    });
+
+    // overwrites the first n elements with rand() values, growing the room if it's too short
+    registry.register_function("rand_fill", [generator, mutex](const ValueVector& args) -> Value {
+        if (args.size() != 2) {
+            throw std::runtime_error("rand_fill() expects exactly 2 arguments");
+        }
+        if (!args[0].get_if<ValueArray>()) {
+            throw std::runtime_error("rand_fill() requires array as first argument");
+        }
+        if (!args[1].get_if<int>() || args[1].get<int>() < 0) {
+            throw std::runtime_error("rand_fill() requires a non-negative count as second argument");
+        }
+
+        size_t count = static_cast<size_t>(args[1].get<int>());
+        ValueVector elements = args[0].get<ValueArray>().elements;
+        if (elements.size() < count) {
+            elements.resize(count);
+        }
+
+        std::lock_guard<std::mutex> lock(*mutex);
+        RandomGenerator& rng = *generator;
+        for (size_t i = 0; i < count; ++i) {
+            elements[i].data = rng.next_float();
+        }
+        return ValueArray(std::move(elements));
+    });
+}
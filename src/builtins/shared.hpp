@@ -0,0 +1,236 @@
+#pragma once
+#include <string>
+#include <memory>
+#include <cstring>
+#include <cerrno>
+#include <atomic>
+#include <stdexcept>
+#include "../parser/functions.hpp"
+#include "handles.hpp"
+#include "persist.hpp"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+/*
+    Shared-memory ROOMs: one process publishes a ROOM of ints or floats into a named POSIX
+    shared memory segment, any number of others attach it read-only. The segment holds the
+    same bytes save() would write (header + packed column), and shm_get() reads straight out
+    of the mapping, so every process shares the one copy.
+
+    shm_open() makes the name visible before the bytes are in, so the publisher fills in
+    everything but the magic first and stores the magic last with release ordering. Attaching
+    loads it with acquire ordering, and a segment without it is still being written.
+*/
+
+// the magic doubles as the ready flag, it's at the start of the mapping so it's page aligned
+std::atomic<uint32_t>& shared_ready_word(const char* mapping) {
+    static_assert(std::atomic<uint32_t>::is_always_lock_free, "the ready flag has to work across processes");
+    return *reinterpret_cast<std::atomic<uint32_t>*>(const_cast<char*>(mapping));
+}
+
+// POSIX wants the name to start with a slash, scripts shouldn't have to care
+std::string shared_segment_name(const std::string& name) {
+    if (name.empty() || name.find('/', 1) != std::string::npos) {
+        throw std::runtime_error("Shared ROOM names can't be empty or contain '/'");
+    }
+    return name[0] == '/' ? name : "/" + name;
+}
+
+class SharedRoom {
+private:
+    const char* mapping = nullptr;
+    size_t length = 0;
+    const char* column = nullptr;
+    size_t count = 0;
+    bool ints = true;
+
+public:
+    explicit SharedRoom(const std::string& name) {
+#ifdef _WIN32
+        (void)name;
+        throw std::runtime_error("Shared ROOMs need POSIX shared memory, which this platform doesn't have");
+#else
+        std::string segment = shared_segment_name(name);
+        int fd = shm_open(segment.c_str(), O_RDONLY, 0);
+        if (fd < 0) {
+            throw std::runtime_error("shm_attach(): no shared ROOM called " + name + " (" + std::strerror(errno) + ")");
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0) {
+            close(fd);
+            throw std::runtime_error("shm_attach(): failed to stat " + name);
+        }
+        length = static_cast<size_t>(info.st_size);
+        if (length == 0) {
+            close(fd);
+            throw std::runtime_error("shm_attach(): " + name + " is still being published");
+        }
+        void* view = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (view == MAP_FAILED) {
+            throw std::runtime_error("shm_attach(): failed to map " + name);
+        }
+        mapping = static_cast<const char*>(view);
+
+        uint32_t magic;
+        std::memcpy(&magic, PERSIST_MAGIC, 4);
+        if (length < 4 || shared_ready_word(mapping).load(std::memory_order_acquire) != magic) {
+            munmap(const_cast<char*>(mapping), length);
+            throw std::runtime_error("shm_attach(): " + name + " isn't a shared ROOM, or is still being published");
+        }
+
+        const size_t column_start = PERSIST_HEADER_SIZE + 1 + sizeof(uint64_t);
+        uint64_t stored_count = 0;
+        if (length >= column_start) {
+            std::memcpy(&stored_count, mapping + PERSIST_HEADER_SIZE + 1, sizeof(uint64_t));
+        }
+        uint8_t tag = length >= column_start ? static_cast<uint8_t>(mapping[PERSIST_HEADER_SIZE]) : 0;
+        if (length < column_start || (tag != TAG_INT_COLUMN && tag != TAG_FLOAT_COLUMN) ||
+            stored_count > (length - column_start) / 4) {
+            munmap(const_cast<char*>(mapping), length);
+            throw std::runtime_error("shm_attach(): " + name + " isn't a shared ROOM");
+        }
+        ints = tag == TAG_INT_COLUMN;
+        count = static_cast<size_t>(stored_count);
+        column = mapping + column_start;
+#endif
+    }
+
+    SharedRoom(const SharedRoom&) = delete;
+    SharedRoom& operator=(const SharedRoom&) = delete;
+
+    ~SharedRoom() {
+#ifndef _WIN32
+        if (mapping) munmap(const_cast<char*>(mapping), length);
+#endif
+    }
+
+    size_t size() const { return count; }
+
+    Value get(size_t index) const {
+        if (ints) {
+            int32_t x;
+            std::memcpy(&x, column + index * 4, 4);
+            return static_cast<int>(x);
+        }
+        float x;
+        std::memcpy(&x, column + index * 4, 4);
+        return x;
+    }
+
+    // the mapping as a document load() understands
+    Value copy() const {
+        return decode_document(mapping, length);
+    }
+};
+
+void publish_shared_room(const std::string& name, const ValueArray& room) {
+    std::string document = encode_document(room, false);
+    const char tag = document.size() > PERSIST_HEADER_SIZE ? document[PERSIST_HEADER_SIZE] : 0;
+    if (tag != static_cast<char>(TAG_INT_COLUMN) && tag != static_cast<char>(TAG_FLOAT_COLUMN)) {
+        throw std::runtime_error("shm_publish() requires a non-empty ROOM of just ints or just floats");
+    }
+#ifdef _WIN32
+    (void)name;
+    throw std::runtime_error("Shared ROOMs need POSIX shared memory, which this platform doesn't have");
+#else
+    std::string segment = shared_segment_name(name);
+    // a fresh segment each time, so anyone attached to the old one keeps a consistent view
+    shm_unlink(segment.c_str());
+    int fd = shm_open(segment.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("shm_publish(): failed to create " + name + " (" + std::strerror(errno) + ")");
+    }
+    if (ftruncate(fd, static_cast<off_t>(document.size())) != 0) {
+        close(fd);
+        shm_unlink(segment.c_str());
+        throw std::runtime_error("shm_publish(): failed to size " + name + " (" + std::strerror(errno) + ")");
+    }
+    void* view = mmap(nullptr, document.size(), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (view == MAP_FAILED) {
+        shm_unlink(segment.c_str());
+        throw std::runtime_error("shm_publish(): failed to map " + name);
+    }
+    char* bytes = static_cast<char*>(view);
+    std::memcpy(bytes + 4, document.data() + 4, document.size() - 4);
+    uint32_t magic;
+    std::memcpy(&magic, document.data(), 4);
+    shared_ready_word(bytes).store(magic, std::memory_order_release);
+    munmap(view, document.size());
+#endif
+}
+
+void register_shared_functions(FunctionRegistry& registry) {
+    auto rooms = std::make_shared<HandleTable<SharedRoom>>();
+
+    registry.register_function("shm_publish", [](const ValueVector& args) -> Value {
+        if (args.size() != 2 || !args[0].get_if<ValueArray>() || !args[1].get_if<std::string>()) {
+            throw std::runtime_error("shm_publish() expects a ROOM and a name");
+        }
+        publish_shared_room(args[1].get<std::string>(), args[0].get<ValueArray>());
+        return 0;
+    });
+
+    registry.register_function("shm_attach", [rooms](const ValueVector& args) -> Value {
+        if (args.size() != 1 || !args[0].get_if<std::string>()) {
+            throw std::runtime_error("shm_attach() expects exactly 1 name argument");
+        }
+        return rooms->add(std::make_shared<SharedRoom>(args[0].get<std::string>()));
+    });
+
+    registry.register_function("shm_len", [rooms](const ValueVector& args) -> Value {
+        if (args.size() != 1) {
+            throw std::runtime_error("shm_len() expects exactly 1 argument");
+        }
+        return static_cast<int>(rooms->get(args[0], "shm_len")->size());
+    });
+
+    registry.register_function("shm_get", [rooms](const ValueVector& args) -> Value {
+        if (args.size() != 2 || !args[1].get_if<int>()) {
+            throw std::runtime_error("shm_get() expects a handle and an index");
+        }
+        auto room = rooms->get(args[0], "shm_get");
+        int index = args[1].get<int>();
+        if (index < 0 || static_cast<size_t>(index) >= room->size()) {
+            throw std::runtime_error("Room index out of bounds");
+        }
+        return room->get(static_cast<size_t>(index));
+    });
+
+    // a normal private ROOM with everything in it, for when a whole copy is what's wanted
+    registry.register_function("shm_copy", [rooms](const ValueVector& args) -> Value {
+        if (args.size() != 1) {
+            throw std::runtime_error("shm_copy() expects exactly 1 argument");
+        }
+        return rooms->get(args[0], "shm_copy")->copy();
+    });
+
+    registry.register_function("shm_detach", [rooms](const ValueVector& args) -> Value {
+        if (args.size() != 1) {
+            throw std::runtime_error("shm_detach() expects exactly 1 argument");
+        }
+        rooms->remove(args[0], "shm_detach");
+        return 0;
+    });
+
+    // removes the name, processes still attached keep their view until they detach
+    registry.register_function("shm_unlink", [](const ValueVector& args) -> Value {
+        if (args.size() != 1 || !args[0].get_if<std::string>()) {
+            throw std::runtime_error("shm_unlink() expects exactly 1 name argument");
+        }
+#ifdef _WIN32
+        throw std::runtime_error("Shared ROOMs need POSIX shared memory, which this platform doesn't have");
+#else
+        if (shm_unlink(shared_segment_name(args[0].get<std::string>()).c_str()) != 0) {
+            throw std::runtime_error("shm_unlink(): no shared ROOM called " + args[0].get<std::string>());
+        }
+        return 0;
+#endif
+    });
+}
@@ -0,0 +1,143 @@
+#pragma once
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include "../parser/functions.hpp"
+
+struct RunningMoments {
+    size_t count = 0;
+    double mean = 0.0;
+    double m2 = 0.0;  // sum of squared differences from the mean
+
+    // Welford's update, stays accurate where sum / sum of squares would cancel out
+    void add(double x) {
+        ++count;
+        double delta = x - mean;
+        mean += delta / static_cast<double>(count);
+        m2 += delta * (x - mean);
+    }
+
+    double variance() const {
+        return count > 0 ? m2 / static_cast<double>(count) : 0.0;
+    }
+};
+
+const ValueArray& expect_room(const ValueVector& args, size_t expected_args, const std::string& function_name) {
+    if (args.size() != expected_args) {
+        throw std::runtime_error(function_name + "() expects exactly " + std::to_string(expected_args) +
+                                 (expected_args == 1 ? " argument" : " arguments"));
+    }
+    const ValueArray* room = args[0].get_if<ValueArray>();
+    if (!room) {
+        throw std::runtime_error(function_name + "() requires array as first argument");
+    }
+    if (room->empty()) {
+        throw std::runtime_error(function_name + "() requires a non-empty array");
+    }
+    return *room;
+}
+
+RunningMoments room_moments(const ValueArray& room, const std::string& function_name) {
+    RunningMoments moments;
+    for (const auto& element : room) {
+        moments.add(value_to_double(element, function_name));
+    }
+    return moments;
+}
+
+// NaN can't be ordered, it would break nth_element and the rank/bin casts
+double number_not_nan(const Value& element, const std::string& function_name) {
+    double x = value_to_double(element, function_name);
+    if (std::isnan(x)) {
+        throw std::runtime_error(function_name + "() can't use NaN values");
+    }
+    return x;
+}
+
+// linear interpolation between the closest ranks, p in [0, 100]
+double room_percentile(const ValueArray& room, double p, const std::string& function_name) {
+    if (!(p >= 0.0 && p <= 100.0)) {
+        throw std::runtime_error(function_name + "() requires a percentile between 0 and 100");
+    }
+
+    std::vector<double> values;
+    values.reserve(room.size());
+    for (const auto& element : room) {
+        values.push_back(number_not_nan(element, function_name));
+    }
+
+    double rank = p / 100.0 * static_cast<double>(values.size() - 1);
+    size_t lower = static_cast<size_t>(std::floor(rank));
+    double fraction = rank - static_cast<double>(lower);
+
+    // nth_element is linear on average, we never need the whole thing sorted
+    std::nth_element(values.begin(), values.begin() + lower, values.end());
+    double low_value = values[lower];
+    if (fraction == 0.0 || lower + 1 == values.size()) return low_value;
+
+    double high_value = *std::min_element(values.begin() + lower + 1, values.end());
+    return low_value + fraction * (high_value - low_value);
+}
+
+void register_stats_functions(FunctionRegistry& registry) {
+    registry.register_function("mean", [](const ValueVector& args) -> Value {
+        const ValueArray& room = expect_room(args, 1, "mean");
+        return static_cast<float>(room_moments(room, "mean").mean);
+    });
+
+    registry.register_function("variance", [](const ValueVector& args) -> Value {
+        const ValueArray& room = expect_room(args, 1, "variance");
+        return static_cast<float>(room_moments(room, "variance").variance());
+    });
+
+    registry.register_function("stddev", [](const ValueVector& args) -> Value {
+        const ValueArray& room = expect_room(args, 1, "stddev");
+        return static_cast<float>(std::sqrt(room_moments(room, "stddev").variance()));
+    });
+
+    registry.register_function("percentile", [](const ValueVector& args) -> Value {
+        const ValueArray& room = expect_room(args, 2, "percentile");
+        double p = value_to_double(args[1], "percentile");
+        return static_cast<float>(room_percentile(room, p, "percentile"));
+    });
+
+    registry.register_function("median", [](const ValueVector& args) -> Value {
+        const ValueArray& room = expect_room(args, 1, "median");
+        return static_cast<float>(room_percentile(room, 50.0, "median"));
+    });
+
+    // equal width bins between the smallest and largest value, gives back the counts
+    registry.register_function("histogram", [](const ValueVector& args) -> Value {
+        const ValueArray& room = expect_room(args, 2, "histogram");
+        if (!args[1].get_if<int>() || args[1].get<int>() <= 0) {
+            throw std::runtime_error("histogram() requires a positive bin count as second argument");
+        }
+        size_t bins = static_cast<size_t>(args[1].get<int>());
+
+        std::vector<double> values;
+        values.reserve(room.size());
+        double low = INFINITY;
+        double high = -INFINITY;
+        for (const auto& element : room) {
+            double x = number_not_nan(element, "histogram");
+            if (std::isinf(x)) {
+                throw std::runtime_error("histogram() can't put infinite values in a bin");
+            }
+            values.push_back(x);
+            low = std::min(low, x);
+            high = std::max(high, x);
+        }
+
+        std::vector<int> counts(bins, 0);
+        double width = (high - low) / static_cast<double>(bins);
+        for (double x : values) {
+            size_t bin = width > 0.0 ? static_cast<size_t>((x - low) / width) : 0;
+            if (bin >= bins) bin = bins - 1;  // the max lands exactly on the upper edge
+            ++counts[bin];
+        }
+
+        ValueVector result(counts.begin(), counts.end());
+        return ValueArray(std::move(result));
+    });
+}
@@ -0,0 +1,171 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <cctype>
+#include <cstring>
+#include <cstdio>
+#include <charconv>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include "../parser/functions.hpp"
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+// Reads fd 0 in big blocks straight into our own buffer, no iostreams involved.
+// Lines and numbers are cut out of the buffer in place.
+class StdinReader {
+private:
+    std::string buffer;
+    size_t position = 0;
+    bool at_eof = false;
+
+    static const size_t BLOCK_SIZE = 1 << 20;
+
+    // false once stdin is done
+    bool fill() {
+        if (at_eof) return false;
+        // drop what's been consumed so the buffer doesn't keep growing
+        if (position > 0) {
+            buffer.erase(0, position);
+            position = 0;
+        }
+        size_t old_size = buffer.size();
+        buffer.resize(old_size + BLOCK_SIZE);
+#ifdef _WIN32
+        size_t got = std::fread(&buffer[old_size], 1, BLOCK_SIZE, stdin);
+        if (got == 0 && std::ferror(stdin)) {
+            buffer.resize(old_size);
+            throw std::runtime_error("Failed to read from stdin");
+        }
+#else
+        ssize_t got;
+        do {
+            got = read(0, &buffer[old_size], BLOCK_SIZE);
+        } while (got < 0 && errno == EINTR);
+        if (got < 0) {
+            buffer.resize(old_size);
+            throw std::runtime_error(std::string("Failed to read from stdin (") + std::strerror(errno) + ")");
+        }
+#endif
+        buffer.resize(old_size + static_cast<size_t>(got));
+        if (got == 0) at_eof = true;
+        return got > 0;
+    }
+
+public:
+    StdinReader() {
+#ifdef _WIN32
+        _setmode(_fileno(stdin), _O_BINARY);
+#endif
+    }
+
+    bool next_line(std::string& line) {
+        size_t searched = position;
+        while (true) {
+            const char* start = buffer.data() + searched;
+            const char* newline = static_cast<const char*>(std::memchr(start, '\n', buffer.size() - searched));
+            if (newline) {
+                size_t end = static_cast<size_t>(newline - buffer.data());
+                size_t length = end - position;
+                if (length > 0 && buffer[end - 1] == '\r') --length;
+                line.assign(buffer, position, length);
+                position = end + 1;
+                return true;
+            }
+            searched = buffer.size() - position;  // fill() moves the unread part to the front
+            if (!fill()) break;
+        }
+        // last line without a newline at the end
+        if (position >= buffer.size()) return false;
+        line.assign(buffer, position, std::string::npos);
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        position = buffer.size();
+        return true;
+    }
+
+    // next whitespace separated word, false at the end
+    bool next_word(std::string_view& word) {
+        while (true) {
+            while (position < buffer.size() && std::isspace(static_cast<unsigned char>(buffer[position]))) ++position;
+            if (position == buffer.size()) {
+                if (!fill()) return false;
+                continue;
+            }
+            size_t end = position;
+            while (end < buffer.size() && !std::isspace(static_cast<unsigned char>(buffer[end]))) ++end;
+            // the word might carry on in the next block, fill() moves things so look again either way
+            if (end == buffer.size() && !at_eof) {
+                fill();
+                continue;
+            }
+            word = std::string_view(buffer.data() + position, end - position);
+            position = end;
+            return true;
+        }
+    }
+};
+
+Value parse_number(std::string_view text) {
+    const char* begin = text.data() + (text[0] == '+' ? 1 : 0);
+    const char* end = text.data() + text.size();
+    int int_value;
+    auto result = std::from_chars(begin, end, int_value);
+    if (result.ec == std::errc() && result.ptr == end) return int_value;
+    if (result.ec == std::errc::result_out_of_range && result.ptr == end) {
+        return BigInt::from_string(std::string(text));
+    }
+    float float_value;
+    result = std::from_chars(begin, end, float_value);
+    if (result.ec == std::errc() && result.ptr == end) return float_value;
+    throw std::runtime_error("read_numbers(): \"" + std::string(text) + "\" isn't a number");
+}
+
+void register_stdin_functions(FunctionRegistry& registry) {
+    auto reader = std::make_shared<StdinReader>();
+    auto mutex = std::make_shared<std::mutex>();
+
+    // the next line without the newline, false once stdin is done
+    registry.register_function("read_line", [reader, mutex](const ValueVector& args) -> Value {
+        if (!args.empty()) {
+            throw std::runtime_error("read_line() expects no arguments");
+        }
+        std::lock_guard<std::mutex> lock(*mutex);
+        std::string line;
+        if (!reader->next_line(line)) return false;
+        return line;
+    });
+
+    registry.register_function("read_lines", [reader, mutex](const ValueVector& args) -> Value {
+        if (!args.empty()) {
+            throw std::runtime_error("read_lines() expects no arguments");
+        }
+        std::lock_guard<std::mutex> lock(*mutex);
+        ValueVector lines;
+        std::string line;
+        while (reader->next_line(line)) {
+            lines.emplace_back(line);
+        }
+        return ValueArray(std::move(lines));
+    });
+
+    // every number left on stdin, split on any whitespace
+    registry.register_function("read_numbers", [reader, mutex](const ValueVector& args) -> Value {
+        if (!args.empty()) {
+            throw std::runtime_error("read_numbers() expects no arguments");
+        }
+        std::lock_guard<std::mutex> lock(*mutex);
+        ValueVector numbers;
+        std::string_view word;
+        while (reader->next_word(word)) {
+            numbers.push_back(parse_number(word));
+        }
+        return ValueArray(std::move(numbers));
+    });
+}
@@ -0,0 +1,152 @@
+#pragma once
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <algorithm>
+#include "parser/functions.hpp"
+
+// one slot per millisecond, a timer further out than this just sits in its slot for more laps
+const size_t TIMER_WHEEL_SLOTS = 512;
+
+/*
+    Timers for run(). They live in a hashed timing wheel: slot = due tick % slots, so adding
+    and cancelling are O(1) and firing only looks at the slot for the current millisecond.
+    Between timers the loop sleeps until the next one is due (or until another thread adds one).
+    Callbacks always run on the thread that called run(), in order of when they're due.
+*/
+class EventLoop {
+public:
+    using Callback = std::function<void(const std::string& function_name, const ValueVector& args)>;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Timer {
+        std::string function_name;
+        ValueVector args;
+        uint64_t due;
+        uint64_t interval;  // 0 for a one-shot timeout
+    };
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::unordered_map<int, Timer> timers;
+    std::vector<std::vector<int>> wheel{TIMER_WHEEL_SLOTS};
+    int next_id = 1;
+    const Clock::time_point start = Clock::now();
+    uint64_t processed = 0;  // every tick up to here has been fired
+
+    uint64_t now_tick() const {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count());
+    }
+
+    void place(int id, const Timer& timer) {
+        wheel[timer.due % TIMER_WHEEL_SLOTS].push_back(id);
+    }
+
+    // The earliest due tick. Looks one lap ahead slot by slot, and only goes through every timer
+    // if nothing is due within a lap.
+    uint64_t next_due() const {
+        for (uint64_t tick = processed + 1; tick <= processed + TIMER_WHEEL_SLOTS; ++tick) {
+            for (int id : wheel[tick % TIMER_WHEEL_SLOTS]) {
+                auto it = timers.find(id);
+                if (it != timers.end() && it->second.due <= tick) return it->second.due;
+            }
+        }
+        uint64_t earliest = UINT64_MAX;
+        for (const auto& [id, timer] : timers) {
+            earliest = std::min(earliest, timer.due);
+        }
+        return earliest;
+    }
+
+    // ids of the timers due at tick, taken out of the slot (ones for later laps stay)
+    void collect_due(uint64_t tick, std::vector<int>& due) {
+        auto& slot = wheel[tick % TIMER_WHEEL_SLOTS];
+        size_t kept = 0;
+        for (int id : slot) {
+            auto it = timers.find(id);
+            if (it == timers.end()) continue;  // cleared
+            if (it->second.due <= tick) due.push_back(id);
+            else slot[kept++] = id;
+        }
+        slot.resize(kept);
+    }
+
+public:
+    int add(const std::string& function_name, ValueVector args, int64_t delay_ms, int64_t interval_ms) {
+        std::lock_guard<std::mutex> lock(mutex);
+        int id = next_id++;
+        // never due before the next tick, so it can't land in a slot that's already been swept
+        uint64_t due = std::max(now_tick() + static_cast<uint64_t>(std::max<int64_t>(delay_ms, 0)), processed + 1);
+        Timer& timer = timers[id] = Timer{function_name, std::move(args), due, static_cast<uint64_t>(interval_ms)};
+        place(id, timer);
+        changed.notify_all();
+        return id;
+    }
+
+    // false if there was no such timer (already fired, or cleared before)
+    bool clear(int id) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return timers.erase(id) > 0;
+    }
+
+    // timers that are still going to fire
+    size_t pending() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return timers.size();
+    }
+
+    // fires timers until there are none left
+    void run(const Callback& fire) {
+        std::vector<int> due;
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!timers.empty()) {
+            uint64_t now = now_tick();
+            if (now <= processed) {
+                uint64_t wake = next_due();
+                changed.wait_until(lock, start + std::chrono::milliseconds(wake), [&] {
+                    return timers.empty() || now_tick() >= wake || next_due() < wake;
+                });
+                continue;
+            }
+
+            // a full lap covers every slot, so after a long callback there's no need to walk every missed tick
+            uint64_t from = now - processed > TIMER_WHEEL_SLOTS ? now - TIMER_WHEEL_SLOTS + 1 : processed + 1;
+            for (uint64_t tick = from; tick <= now; ++tick) {
+                collect_due(tick, due);
+            }
+            processed = now;
+            std::sort(due.begin(), due.end(), [this](int a, int b) {
+                const Timer& x = timers.at(a);
+                const Timer& y = timers.at(b);
+                return x.due != y.due ? x.due < y.due : a < b;
+            });
+
+            for (int id : due) {
+                auto it = timers.find(id);
+                if (it == timers.end()) continue;  // an earlier callback cleared it
+                std::string function_name = it->second.function_name;
+                ValueVector args = it->second.args;
+                if (it->second.interval > 0) {
+                    // keeps to its own schedule, but skips the beats it missed instead of firing them all at once
+                    it->second.due += it->second.interval;
+                    if (it->second.due <= processed) it->second.due = processed + it->second.interval;
+                    place(id, it->second);
+                } else {
+                    timers.erase(it);
+                }
+
+                lock.unlock();
+                fire(function_name, args);
+                lock.lock();
+            }
+            due.clear();
+        }
+    }
+};
@@ -4,47 +4,127 @@
 #include <stdexcept>
 #include <iostream>
 #include <cmath>
+#include <climits>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <deque>
+#include <exception>
 #include "parser/expressions.hpp"
 #include "parser/statements.hpp"
 #include "parser/functions.hpp"
+#include "program.hpp"
+#include "output.hpp"
+#include "tasks.hpp"
+#include "isolates.hpp"
+#include "event_loop.hpp"
 #include <math.h>
 
-struct ReturnException {
-    Value value;
-    ReturnException(const Value& val) : value(val) {}
-};
-
-struct UserFunction {
-    std::vector<std::string> parameters;
-    const Statement* body;
+// below this many elements per thread, starting the thread costs more than it saves
+const size_t PFOR_MIN_ELEMENTS_PER_THREAD = 16;
 
-    UserFunction(std::vector<std::string> params, const Statement* func_body)
-        : parameters(std::move(params)), body(func_body) {}
+struct UndoEntry {
+    const std::string* name;
+    bool existed;
+    Value old_value;
 };
 
+// One run of a CompiledProgram: variables, the call stack and spawned tasks. The program itself
+// is only ever read, so give each thread its own Interpreter and they can all share one compile.
 class Interpreter {
 private:
+    std::shared_ptr<const CompiledProgram> compiled;
+    std::shared_ptr<FunctionRegistry> run_builtins;  // this run's stateful builtins, shared with its workers and tasks
+    FunctionRegistry& function_registry;
     std::unordered_map<std::string, Value> variables;
+    // functions declared inside blocks, the top-level ones live in compiled
     std::unordered_map<std::string, UserFunction> user_functions;
-    FunctionRegistry function_registry;
+
+    // A pfor worker reads everything it didn't declare from the context that started the loop, and
+    // that one may be a pfor worker too (a pfor inside a function called from a pfor body). Whoever
+    // is in the chain is stuck waiting on the loop, so nothing up there changes while it reads.
+    const Interpreter* outer = nullptr;
+
+    // spawned tasks, shared by every context that came from the same script
+    std::shared_ptr<TaskScheduler> task_scheduler;
+    std::shared_ptr<IsolateScheduler> isolate_scheduler;
+    std::shared_ptr<EventLoop> event_loop;
+    bool is_worker = false;
+
+    // ret values land here (first one is also the call's value), reused so returning doesn't allocate
+    ValueVector return_registers;
+    ValueVector operand_stack;
+
+    // Argument lists get reused, one per level of calls inside arguments, so a call only allocates
+    // the first time its level is reached. A deque so outer levels stay put when inner ones are added.
+    std::deque<ValueVector> argument_buffers;
+    size_t argument_depth = 0;
+
+    // the argument list for one call, handed back empty (capacity kept) once the call is over
+    struct ArgumentBuffer {
+        Interpreter& context;
+        ValueVector& args;
+
+        explicit ArgumentBuffer(Interpreter& owner)
+            : context(owner),
+              args(owner.argument_depth == owner.argument_buffers.size() ? owner.argument_buffers.emplace_back()
+                                                                         : owner.argument_buffers[owner.argument_depth]) {
+            ++context.argument_depth;
+        }
+        ~ArgumentBuffer() {
+            args.clear();
+            --context.argument_depth;
+        }
+    };
+
+    // what calls overwrote, undone when they return
+    std::vector<UndoEntry> undo_log;
+    size_t frame_start = 0;  // where the running call's entries start in undo_log
+    size_t call_depth = 0;
+
+    // the top-level statement that's running, so checkpoint() knows where to pick up again
+    const Program* running_program = nullptr;
+    size_t running_statement = 0;
 
 public:
+    explicit Interpreter(std::shared_ptr<const CompiledProgram> program)
+        : compiled(std::move(program)), run_builtins(compiled->run_builtins()), function_registry(*run_builtins),
+          task_scheduler(std::make_shared<TaskScheduler>()), isolate_scheduler(std::make_shared<IsolateScheduler>()),
+          event_loop(std::make_shared<EventLoop>()) {}
+
+    // pfor worker or task context for parent, see execute_pfor and spawn_task
+    explicit Interpreter(const Interpreter* parent)
+        : compiled(parent->compiled), run_builtins(parent->run_builtins), function_registry(*run_builtins),
+          user_functions(parent->user_functions), outer(parent),
+          task_scheduler(parent->task_scheduler), isolate_scheduler(parent->isolate_scheduler),
+          event_loop(parent->event_loop), is_worker(true) {}
+
+    ~Interpreter() {
+        // a run isn't over until the tasks it started (awaited or not) are
+        if (is_worker) return;
+        isolate_scheduler->wait_idle();
+        task_scheduler->wait_idle();
+        isolate_scheduler->clear();
+    }
+
     Value evaluate_expression(const Expression* expr) {
         if (auto int_lit = dynamic_cast<const IntLiteral*>(expr)) return int_lit->value;
         else if (auto float_lit = dynamic_cast<const FloatLiteral*>(expr)) return float_lit->value;
         else if (auto string_lit = dynamic_cast<const StringLiteral*>(expr)) return string_lit->value;
         else if (auto bool_lit = dynamic_cast<const BooleanLiteral*>(expr)) return bool_lit->value;
         else if (auto identifier = dynamic_cast<const Identifier*>(expr)) {
-            auto it = variables.find(identifier->name);
-            if (it == variables.end()) {
+            const Value* value = find_variable(identifier->name);
+            if (!value) {
                 throw std::runtime_error("Undefined variable: " + identifier->name);
             }
-            return it->second;
+            return *value;
         }
         else if (auto binary_expr = dynamic_cast<const BinaryExpression*>(expr)) return evaluate_binary_expression(binary_expr);
         else if (auto unary_expr = dynamic_cast<const UnaryExpression*>(expr)) return evaluate_unary_expression(unary_expr);
         else if (auto paren_expr = dynamic_cast<const ParenthesizedExpression*>(expr)) return evaluate_expression(paren_expr->expression.get());
         else if (auto func_call = dynamic_cast<const FunctionCall*>(expr)) return evaluate_function_call(func_call);
+        else if (auto spawn = dynamic_cast<const SpawnExpression*>(expr)) return spawn_task(spawn);
+        else if (auto await = dynamic_cast<const AwaitExpression*>(expr)) return task_scheduler->await(evaluate_expression(await->task.get()));
         else if (auto room_lit = dynamic_cast<const RoomLiteral*>(expr)) {
             ValueVector elements;
             for (const auto& element : room_lit->elements) {
@@ -54,11 +134,21 @@ public:
         }
         else if(auto room_access = dynamic_cast<const RoomAccess*>(expr)){
 
-            if(variables.find(room_access->room_name) == variables.end()){
+            const Value* room_value = find_variable(room_access->room_name);
+            if(!room_value){
                 throw std::runtime_error("Undefined room: " + room_access->room_name);
             }
+
+            if(auto map = room_value->get_if<ValueMap>()){
+                Value key = evaluate_expression(room_access->index.get());
+                const Value* found = map->find(key);
+                if(!found){
+                    throw std::runtime_error("key not found in room: " + value_to_string(key));
+                }
+                return *found;
+            }
             
-            if(!variables[room_access->room_name].holds<ValueArray>()){
+            if(!room_value->holds<ValueArray>()){
                 throw std::runtime_error("Not a room: " + room_access->room_name);
             }
 
@@ -71,7 +161,7 @@ public:
                 }
             }, index_val.data);
 
-            ValueArray& room = variables[room_access->room_name].get<ValueArray>();
+            const ValueArray& room = room_value->get<ValueArray>();
             if (index < 0 || index >= static_cast<int>(room.size())) {
                 throw std::runtime_error("room index out of bounds");
             }
@@ -84,13 +174,25 @@ public:
     Value evaluate_binary_expression(const BinaryExpression* expr) {
         Value left = evaluate_expression(expr->left.get());
         Value right = evaluate_expression(expr->right.get());
+        return apply_binary(expr->operator_type, left, right);
+    }
 
-        switch (expr->operator_type) {
+    static Value apply_binary(TokenType operator_type, const Value& left, const Value& right) {
+        switch (operator_type) {
             case TokenType::PLUS:
                 return std::visit([](const auto& l, const auto& r) -> Value {
-                    if constexpr (std::is_arithmetic_v<std::decay_t<decltype(l)>> &&
-                                  std::is_arithmetic_v<std::decay_t<decltype(r)>>) {
+                    using L = std::decay_t<decltype(l)>;
+                    using R = std::decay_t<decltype(r)>;
+                    if constexpr (is_integer_v<L> && is_integer_v<R> && std::is_arithmetic_v<L> && std::is_arithmetic_v<R>) {
+                        int result;
+                        if (!add_overflows(l, r, result)) return result;
+                        return BigInt(l) + BigInt(r);
+                    } else if constexpr (is_integer_v<L> && is_integer_v<R>) {
+                        return normalize_integer(to_bigint(l) + to_bigint(r));
+                    } else if constexpr (std::is_arithmetic_v<L> && std::is_arithmetic_v<R>) {
                         return l + r;
+                    } else if constexpr (is_numeric_v<L> && is_numeric_v<R>) {
+                        return to_float(l) + to_float(r);
                     } else {
                         throw std::runtime_error("Invalid operands for +");
                     }
@@ -98,9 +200,18 @@ public:
             
             case TokenType::MINUS:
                 return std::visit([](const auto& l, const auto& r) -> Value {
-                    if constexpr (std::is_arithmetic_v<std::decay_t<decltype(l)>> &&
-                                  std::is_arithmetic_v<std::decay_t<decltype(r)>>) {
+                    using L = std::decay_t<decltype(l)>;
+                    using R = std::decay_t<decltype(r)>;
+                    if constexpr (is_integer_v<L> && is_integer_v<R> && std::is_arithmetic_v<L> && std::is_arithmetic_v<R>) {
+                        int result;
+                        if (!sub_overflows(l, r, result)) return result;
+                        return BigInt(l) - BigInt(r);
+                    } else if constexpr (is_integer_v<L> && is_integer_v<R>) {
+                        return normalize_integer(to_bigint(l) - to_bigint(r));
+                    } else if constexpr (std::is_arithmetic_v<L> && std::is_arithmetic_v<R>) {
                         return l - r;
+                    } else if constexpr (is_numeric_v<L> && is_numeric_v<R>) {
+                        return to_float(l) - to_float(r);
                     } else {
                         throw std::runtime_error("Invalid operands for -");
                     }
@@ -108,9 +219,18 @@ public:
             
             case TokenType::STAR:
                 return std::visit([](const auto& l, const auto& r) -> Value {
-                    if constexpr (std::is_arithmetic_v<std::decay_t<decltype(l)>> &&
-                                  std::is_arithmetic_v<std::decay_t<decltype(r)>>) {
+                    using L = std::decay_t<decltype(l)>;
+                    using R = std::decay_t<decltype(r)>;
+                    if constexpr (is_integer_v<L> && is_integer_v<R> && std::is_arithmetic_v<L> && std::is_arithmetic_v<R>) {
+                        int result;
+                        if (!mul_overflows(l, r, result)) return result;
+                        return BigInt(l) * BigInt(r);
+                    } else if constexpr (is_integer_v<L> && is_integer_v<R>) {
+                        return normalize_integer(to_bigint(l) * to_bigint(r));
+                    } else if constexpr (std::is_arithmetic_v<L> && std::is_arithmetic_v<R>) {
                         return l * r;
+                    } else if constexpr (is_numeric_v<L> && is_numeric_v<R>) {
+                        return to_float(l) * to_float(r);
                     } else {
                         throw std::runtime_error("Invalid operands for *");
                     }
@@ -118,10 +238,21 @@ public:
             
             case TokenType::SLASH:
                 return std::visit([](const auto& l, const auto& r) -> Value {
-                    if constexpr (std::is_arithmetic_v<std::decay_t<decltype(l)>> &&
-                                  std::is_arithmetic_v<std::decay_t<decltype(r)>>) {
+                    using L = std::decay_t<decltype(l)>;
+                    using R = std::decay_t<decltype(r)>;
+                    if constexpr (is_integer_v<L> && is_integer_v<R> && std::is_arithmetic_v<L> && std::is_arithmetic_v<R>) {
                         if (r == 0) throw std::runtime_error("Division by zero");
+                        // INT_MIN / -1 is the one int quotient that doesn't fit
+                        if (static_cast<int>(l) == INT_MIN && static_cast<int>(r) == -1) return BigInt(l) / BigInt(r);
                         return l / r;
+                    } else if constexpr (is_integer_v<L> && is_integer_v<R>) {
+                        return normalize_integer(to_bigint(l) / to_bigint(r));
+                    } else if constexpr (std::is_arithmetic_v<L> && std::is_arithmetic_v<R>) {
+                        if (r == 0) throw std::runtime_error("Division by zero");
+                        return l / r;
+                    } else if constexpr (is_numeric_v<L> && is_numeric_v<R>) {
+                        if (to_float(r) == 0) throw std::runtime_error("Division by zero");
+                        return to_float(l) / to_float(r);
                     } else {
                         throw std::runtime_error("Invalid operands for /");
                     }
@@ -129,9 +260,9 @@ public:
 
             case TokenType::CARET:
                 return std::visit([](const auto& l, const auto& r) -> Value {
-                    if constexpr (std::is_arithmetic_v<std::decay_t<decltype(l)>> &&
-                                  std::is_arithmetic_v<std::decay_t<decltype(r)>>) {
-                        return static_cast<float>(std::pow(l, r));
+                    if constexpr (is_numeric_v<std::decay_t<decltype(l)>> &&
+                                  is_numeric_v<std::decay_t<decltype(r)>>) {
+                        return static_cast<float>(std::pow(to_float(l), to_float(r)));
                     } else {
                         throw std::runtime_error("Invalid operands for ^");
                     }
@@ -147,12 +278,20 @@ public:
 
     Value evaluate_unary_expression(const UnaryExpression* expr) {
         Value operand = evaluate_expression(expr->operand.get());
+        return apply_unary(expr->operator_type, operand);
+    }
 
-        switch (expr->operator_type) {
+    static Value apply_unary(TokenType operator_type, const Value& operand) {
+        switch (operator_type) {
             case TokenType::MINUS:
                 return std::visit([](const auto& val) -> Value {
-                    if constexpr (std::is_arithmetic_v<std::decay_t<decltype(val)>>) {
+                    if constexpr (std::is_same_v<std::decay_t<decltype(val)>, int>) {
+                        if (val == INT_MIN) return -BigInt(val);
+                        return -val;
+                    } else if constexpr (std::is_arithmetic_v<std::decay_t<decltype(val)>>) {
                         return -val;
+                    } else if constexpr (std::is_same_v<std::decay_t<decltype(val)>, BigInt>) {
+                        return normalize_integer(-val);
                     } else {
                         throw std::runtime_error("Invalid operand for unary -");
                     }
@@ -173,17 +312,131 @@ public:
     }
 
     Value evaluate_function_call(const FunctionCall* func_call) {
-        ValueVector args;
+        ArgumentBuffer buffer(*this);
         for (const auto& arg_expr : func_call->arguments) {
+            buffer.args.push_back(evaluate_expression(arg_expr.get()));
+        }
+
+        return call_function(func_call->function_name, buffer.args);
+    }
+
+    Value call_function(const std::string& name, const ValueVector& args) {
+        if (const UserFunction* func = find_user_function(name)) {
+            return call_user_function(*func, args);
+        }
+
+        // these need this run's variables, so they can't be ordinary builtins in the shared registry
+        if (name == "checkpoint") {
+            if (args.size() != 1 || !args[0].get_if<std::string>()) {
+                throw std::runtime_error("checkpoint() expects exactly 1 path argument");
+            }
+            write_checkpoint(args[0].get<std::string>());
+            return 0;
+        }
+        if (name == "pmap") return parallel_map(args);
+        if (name == "preduce") return parallel_reduce(args);
+        if (name == "isolate") return create_isolate(args);
+        if (name == "tell") {
+            if (args.size() != 2) {
+                throw std::runtime_error("tell() expects an isolate and a message");
+            }
+            isolate_scheduler->send(args[0], args[1]);
+            return 0;
+        }
+        if (name == "isolate_state") {
+            if (args.size() != 1) {
+                throw std::runtime_error("isolate_state() expects exactly 1 argument");
+            }
+            return isolate_scheduler->state(args[0], "isolate_state");
+        }
+        if (name == "set_timeout") return add_timer(args, "set_timeout");
+        if (name == "set_interval") return add_timer(args, "set_interval");
+        if (name == "clear_timer") {
+            if (args.size() != 1 || !args[0].get_if<int>()) {
+                throw std::runtime_error("clear_timer() expects a timer id");
+            }
+            return event_loop->clear(args[0].get<int>());
+        }
+        if (name == "run") {
+            if (!args.empty()) {
+                throw std::runtime_error("run() doesn't take any arguments");
+            }
+            event_loop->run([this](const std::string& function_name, const ValueVector& call_args) {
+                call_function(function_name, call_args);
+            });
+            return 0;
+        }
+        if (name == "isolate_stop") {
+            if (args.size() != 1) {
+                throw std::runtime_error("isolate_stop() expects exactly 1 argument");
+            }
+            return isolate_scheduler->stop(args[0]);
+        }
+
+        return function_registry.call_function(name, args);
+    }
+
+    // the builtins call_function handles itself
+    static bool is_intrinsic(const std::string& name) {
+        return INTRINSICS.count(name) > 0;
+    }
+
+    const UserFunction* find_user_function(const std::string& name) const {
+        auto it = user_functions.find(name);
+        if (it != user_functions.end()) return &it->second;
+        return compiled->find_function(name);
+    }
+
+    // The arguments are worked out right here, then the call runs on the scheduler in a context
+    // of its own. That context only has the arguments (no globals), so the task and the code
+    // that spawned it can't step on each other's variables.
+    Value spawn_task(const SpawnExpression* spawn) {
+        ValueVector args;
+        for (const auto& arg_expr : spawn->call->arguments) {
             args.push_back(evaluate_expression(arg_expr.get()));
         }
+        auto context = std::make_shared<Interpreter>(this);
+        context->outer = nullptr;
+        const std::string* name = &spawn->call->function_name;
+        return task_scheduler->spawn([context, name, args = std::move(args)]() {
+            return context->call_function(*name, args);
+        });
+    }
 
-        auto user_func_it = user_functions.find(func_call->function_name);
-        if (user_func_it != user_functions.end()) {
-            return call_user_function(user_func_it->second, args);
+    // set_timeout("f", ms, args...) calls f(args...) once, ms from now. set_interval keeps calling it
+    // every ms. Either way it only happens inside run(), on the thread that called it.
+    Value add_timer(const ValueVector& args, const std::string& caller) {
+        if (args.size() < 2 || !args[0].get_if<std::string>() || !args[1].get_if<int>()) {
+            throw std::runtime_error(caller + "() expects a function name and a delay in milliseconds");
+        }
+        const std::string& function_name = args[0].get<std::string>();
+        if (!find_user_function(function_name) && !function_registry.function_exists(function_name) &&
+            !is_intrinsic(function_name)) {
+            throw std::runtime_error(caller + "(): no function called " + function_name);
+        }
+        int delay = args[1].get<int>();
+        bool repeat = caller == "set_interval";
+        if (delay < 0 || (repeat && delay == 0)) {
+            throw std::runtime_error(caller + "() needs a " + (repeat ? "positive" : "non-negative") + " delay");
         }
+        ValueVector call_args(args.begin() + 2, args.end());
+        return event_loop->add(function_name, std::move(call_args), delay, repeat ? delay : 0);
+    }
 
-        return function_registry.call_function(func_call->function_name, args);
+    // isolate("handler", state): an actor with a context of its own (no globals, like a task) that
+    // runs handler(state, message) for every message told to it, keeping what it gives back
+    Value create_isolate(const ValueVector& args) {
+        const std::string* name = args.size() == 2 ? args[0].get_if<std::string>() : nullptr;
+        const UserFunction* handler = name ? find_user_function(*name) : nullptr;
+        if (!handler || handler->parameters.size() != 2) {
+            throw std::runtime_error("isolate() expects the name of a function taking (state, message) and a starting state");
+        }
+        auto context = std::make_shared<Interpreter>(this);
+        context->outer = nullptr;
+        UserFunction function = *handler;
+        return isolate_scheduler->create([context, function](const ValueVector& call_args) {
+            return context->call_user_function(function, call_args);
+        }, args[1]);
     }
 
     Value call_user_function(const UserFunction& func, const ValueVector& args) {
@@ -192,82 +445,161 @@ public:
                                    " arguments, got " + std::to_string(args.size()));
         }
 
-        auto saved_variables = variables;
+        // instead of copying every variable, remember what the call overwrites and put it back after
+        size_t undo_mark = undo_log.size();
+        size_t caller_frame = frame_start;
+        frame_start = undo_mark;
+        ++call_depth;
 
         for (size_t i = 0; i < func.parameters.size(); ++i) {
-            variables[func.parameters[i]] = args[i];
+            set_variable(func.parameters[i], args[i]);
         }
 
         Value return_value = 0;
-
-        try {
-            execute_statement(func.body);
-        } catch (const ReturnException& ret) {
-            return_value = ret.value;
+        if (run_function_body(func) == ExecResult::RETURN) {
+            return_value = return_registers[0];
+        } else {
+            return_registers.clear();
         }
 
-        variables = saved_variables;
+        --call_depth;
+        while (undo_log.size() > undo_mark) {
+            UndoEntry& entry = undo_log.back();
+            if (entry.existed) {
+                variables[*entry.name] = std::move(entry.old_value);
+            } else {
+                variables.erase(*entry.name);
+            }
+            undo_log.pop_back();
+        }
+        frame_start = caller_frame;
 
         return return_value;
     }
 
-    void execute_statement(const Statement* stmt) {
+    // the closures once they're ready, the AST until then (counting calls to see if it's hot)
+    ExecResult run_function_body(const UserFunction& func) {
+        if (func.tier) {
+            if (const FastCode* fast = func.tier->code.load(std::memory_order_acquire)) {
+                return fast->body(*this);
+            }
+            if (func.tier->calls.fetch_add(1, std::memory_order_relaxed) + 1 == TIER_UP_CALLS) {
+                const CompiledProgram* program = compiled.get();
+                const Statement* body = func.body;
+                compiled->tiers().enqueue(*func.tier, [program, body] {
+                    auto code = std::make_unique<FastCode>();
+                    code->body = compile_statement(*program, body);
+                    return code;
+                });
+            }
+        }
+        return execute_statement(func.body);
+    }
+
+    const Value* find_variable(const std::string& name) const {
+        auto it = variables.find(name);
+        if (it != variables.end()) return &it->second;
+        return outer ? outer->find_variable(name) : nullptr;
+    }
+
+    void set_variable(const std::string& name, Value value) {
+        if (call_depth > 0) {
+            remember_variable(name);
+        }
+        variables[name] = std::move(value);
+    }
+
+    // Name has to outlive the call, it always points into the AST or a UserFunction. Only the first
+    // write in a call needs remembering, so writing a ROOM k times doesn't copy it k times.
+    void remember_variable(const std::string& name) {
+        for (size_t i = frame_start; i < undo_log.size(); ++i) {
+            if (undo_log[i].name == &name || *undo_log[i].name == name) return;
+        }
+        auto it = variables.find(name);
+        if (it == variables.end()) {
+            undo_log.push_back(UndoEntry{&name, false, Value()});
+        } else {
+            undo_log.push_back(UndoEntry{&name, true, it->second});
+        }
+    }
+
+    ExecResult execute_statement(const Statement* stmt) {
         if (auto var_decl = dynamic_cast<const VariableDeclaration*>(stmt)) {
             Value value = 0;
             if (var_decl->initializer) {
                 value = evaluate_expression(var_decl->initializer.get());
             }
-            variables[var_decl->name] = value;
+            set_variable(var_decl->name, std::move(value));
+        }
+        else if (auto destructure = dynamic_cast<const DestructuringDeclaration*>(stmt)) {
+            execute_destructuring(destructure);
         }
         else if (auto func_decl = dynamic_cast<const FunctionDeclaration*>(stmt)) {
+            // top-level ones were picked up at compile time
+            const UserFunction* existing = compiled->find_function(func_decl->name);
+            if (existing && existing->body == func_decl->body.get()) return ExecResult::NORMAL;
             user_functions.emplace(func_decl->name, UserFunction(func_decl->parameters, func_decl->body.get()));
         }
         else if (auto assign_stmt = dynamic_cast<const AssignmentStatement*>(stmt)) {
             Value value = evaluate_expression(assign_stmt->value.get());
-            variables[assign_stmt->variable_name] = value;
+            set_variable(assign_stmt->variable_name, std::move(value));
         }
         else if (auto expr_stmt = dynamic_cast<const ExpressionStatement*>(stmt)) {
             Value result = evaluate_expression(expr_stmt->expression.get());
         }
         else if (auto if_stmt = dynamic_cast<const IfStatement*>(stmt)) {
             Value condition = evaluate_expression(if_stmt->condition.get());
-            bool is_true = std::visit([](const auto& val) -> bool {
-                if constexpr (std::is_same_v<std::decay_t<decltype(val)>, bool>) {
-                    return val;
-                } else if constexpr (std::is_arithmetic_v<std::decay_t<decltype(val)>>) {
-                    return val != 0;
-                } else if constexpr (std::is_same_v<std::decay_t<decltype(val)>, std::string>) {
-                    return !val.empty();
-                } else if constexpr (std::is_same_v<std::decay_t<decltype(val)>, ValueArray>) {
-                    return !val.empty();
-                } else {
-                    return false;
-                }
-            }, condition.data);
-
-            if (is_true) {
-                execute_statement(if_stmt->then_statement.get());
+            if (is_truthy(condition)) {
+                return execute_statement(if_stmt->then_statement.get());
             } else if (if_stmt->else_statement) {
-                execute_statement(if_stmt->else_statement.get());
+                return execute_statement(if_stmt->else_statement.get());
             }
         }
+        else if (auto pfor = dynamic_cast<const PforStatement*>(stmt)) {
+            execute_pfor(pfor);
+        }
         else if (auto block_stmt = dynamic_cast<const BlockStatement*>(stmt)) {
             for (const auto& statement : block_stmt->statements) {
-                execute_statement(statement.get());
+                if (execute_statement(statement.get()) == ExecResult::RETURN) {
+                    return ExecResult::RETURN;
+                }
             }
         }
         else if (auto ret_stmt = dynamic_cast<const ReturnStatement*>(stmt)) {
-            Value return_value = 0; 
-            if (ret_stmt->value) {
-                return_value = evaluate_expression(ret_stmt->value.get());
+            if (ret_stmt->values.size() <= 1) {
+                Value return_value = 0;
+                if (!ret_stmt->values.empty()) {
+                    return_value = evaluate_expression(ret_stmt->values[0].get());
+                }
+                return_registers.clear();
+                return_registers.push_back(std::move(return_value));
+            } else {
+                // calls in later values would clobber the registers, so stage everything on the operand stack first
+                size_t base = operand_stack.size();
+                for (const auto& value : ret_stmt->values) {
+                    operand_stack.push_back(evaluate_expression(value.get()));
+                }
+                return_registers.clear();
+                for (size_t i = base; i < operand_stack.size(); ++i) {
+                    return_registers.push_back(std::move(operand_stack[i]));
+                }
+                operand_stack.resize(base);
             }
-            throw ReturnException(return_value);
+            return ExecResult::RETURN;
         }
         else if (auto room_assign = dynamic_cast<const RoomAssignmentStatement*>(stmt)){
             if (variables.find(room_assign->room_name) == variables.end()) {
                 throw std::runtime_error("Undefined room: " + room_assign->room_name);
             }
 
+            if (variables[room_assign->room_name].holds<ValueMap>()) {
+                Value key = evaluate_expression(room_assign->index.get());
+                Value new_value = evaluate_expression(room_assign->value.get());
+                if (call_depth > 0) remember_variable(room_assign->room_name);
+                variables[room_assign->room_name].get<ValueMap>().set(key, new_value);
+                return ExecResult::NORMAL;
+            }
+
             Value index_val = evaluate_expression(room_assign->index.get());
             int index = std::visit([](const auto& val) -> int {
                 if constexpr (std::is_arithmetic_v<std::decay_t<decltype(val)>>) {
@@ -287,22 +619,488 @@ public:
             if (index < 0 || index >= static_cast<int>(room.size())) {
                 throw std::runtime_error("Room index out of bounds");
             }
+            if (call_depth > 0) remember_variable(room_assign->room_name);
             room[index] = new_value;
         }
         else {
             throw std::runtime_error("Unknown statement type");
         }
+        return ExecResult::NORMAL;
     }
 
-    void execute_program(const Program* program) {
+    using FastExpression = std::function<Value(Interpreter&)>;
+    using FastStatement = std::function<ExecResult(Interpreter&)>;
+
+    // The closure tier. Runs on the tier compiler's thread, so it only reads the AST and the
+    // program, never an Interpreter. Everything it doesn't handle becomes a closure that hands
+    // the node back to evaluate_expression/execute_statement, so any function can be compiled.
+    static FastExpression compile_expression(const CompiledProgram& program, const Expression* expr) {
+        if (auto int_lit = dynamic_cast<const IntLiteral*>(expr)) {
+            Value value = int_lit->value;
+            return [value](Interpreter&) { return value; };
+        }
+        else if (auto float_lit = dynamic_cast<const FloatLiteral*>(expr)) {
+            Value value = float_lit->value;
+            return [value](Interpreter&) { return value; };
+        }
+        else if (auto string_lit = dynamic_cast<const StringLiteral*>(expr)) {
+            Value value = string_lit->value;
+            return [value](Interpreter&) { return value; };
+        }
+        else if (auto bool_lit = dynamic_cast<const BooleanLiteral*>(expr)) {
+            Value value = bool_lit->value;
+            return [value](Interpreter&) { return value; };
+        }
+        else if (auto identifier = dynamic_cast<const Identifier*>(expr)) {
+            const std::string* name = &identifier->name;
+            return [name](Interpreter& context) -> Value {
+                const Value* value = context.find_variable(*name);
+                if (!value) {
+                    throw std::runtime_error("Undefined variable: " + *name);
+                }
+                return *value;
+            };
+        }
+        else if (auto binary_expr = dynamic_cast<const BinaryExpression*>(expr)) {
+            FastExpression left = compile_expression(program, binary_expr->left.get());
+            FastExpression right = compile_expression(program, binary_expr->right.get());
+            TokenType operator_type = binary_expr->operator_type;
+            return [left, right, operator_type](Interpreter& context) {
+                Value l = left(context);
+                Value r = right(context);
+                return apply_binary(operator_type, l, r);
+            };
+        }
+        else if (auto unary_expr = dynamic_cast<const UnaryExpression*>(expr)) {
+            FastExpression operand = compile_expression(program, unary_expr->operand.get());
+            TokenType operator_type = unary_expr->operator_type;
+            return [operand, operator_type](Interpreter& context) {
+                return apply_unary(operator_type, operand(context));
+            };
+        }
+        else if (auto paren_expr = dynamic_cast<const ParenthesizedExpression*>(expr)) {
+            return compile_expression(program, paren_expr->expression.get());
+        }
+        else if (auto func_call = dynamic_cast<const FunctionCall*>(expr)) {
+            return compile_call(program, func_call);
+        }
+        else if (auto room_lit = dynamic_cast<const RoomLiteral*>(expr)) {
+            std::vector<FastExpression> elements;
+            for (const auto& element : room_lit->elements) {
+                elements.push_back(compile_expression(program, element.get()));
+            }
+            return [elements](Interpreter& context) {
+                ValueVector values;
+                values.reserve(elements.size());
+                for (const auto& element : elements) {
+                    values.push_back(element(context));
+                }
+                return Value(ValueArray(std::move(values)));
+            };
+        }
+        return [expr](Interpreter& context) { return context.evaluate_expression(expr); };
+    }
+
+    // Top-level functions and the shared builtins can be found now instead of on every call. The
+    // builtins that keep state belong to each run, so those (and functions declared inside blocks,
+    // which shadow everything) go the long way.
+    static FastExpression compile_call(const CompiledProgram& program, const FunctionCall* func_call) {
+        std::vector<FastExpression> arguments;
+        for (const auto& arg : func_call->arguments) {
+            arguments.push_back(compile_expression(program, arg.get()));
+        }
+        const std::string* name = &func_call->function_name;
+        const UserFunction* user_function = program.find_function(*name);
+        const BuiltinFunction* builtin = nullptr;
+        if (!user_function && !is_intrinsic(*name)) {
+            builtin = program.builtins().find_function(*name);
+        }
+
+        return [arguments, name, user_function, builtin](Interpreter& context) {
+            ArgumentBuffer buffer(context);
+            ValueVector& args = buffer.args;
+            for (const auto& argument : arguments) {
+                args.push_back(argument(context));
+            }
+            if (context.user_functions.empty()) {
+                if (user_function) return context.call_user_function(*user_function, args);
+                if (builtin) return (*builtin)(args);
+            }
+            return context.call_function(*name, args);
+        };
+    }
+
+    static FastStatement compile_statement(const CompiledProgram& program, const Statement* stmt) {
+        if (auto var_decl = dynamic_cast<const VariableDeclaration*>(stmt)) {
+            const std::string* name = &var_decl->name;
+            if (!var_decl->initializer) {
+                return [name](Interpreter& context) {
+                    context.set_variable(*name, 0);
+                    return ExecResult::NORMAL;
+                };
+            }
+            FastExpression initializer = compile_expression(program, var_decl->initializer.get());
+            return [name, initializer](Interpreter& context) {
+                context.set_variable(*name, initializer(context));
+                return ExecResult::NORMAL;
+            };
+        }
+        else if (auto assign_stmt = dynamic_cast<const AssignmentStatement*>(stmt)) {
+            const std::string* name = &assign_stmt->variable_name;
+            FastExpression value = compile_expression(program, assign_stmt->value.get());
+            return [name, value](Interpreter& context) {
+                context.set_variable(*name, value(context));
+                return ExecResult::NORMAL;
+            };
+        }
+        else if (auto expr_stmt = dynamic_cast<const ExpressionStatement*>(stmt)) {
+            FastExpression expression = compile_expression(program, expr_stmt->expression.get());
+            return [expression](Interpreter& context) {
+                expression(context);
+                return ExecResult::NORMAL;
+            };
+        }
+        else if (auto if_stmt = dynamic_cast<const IfStatement*>(stmt)) {
+            FastExpression condition = compile_expression(program, if_stmt->condition.get());
+            FastStatement then_statement = compile_statement(program, if_stmt->then_statement.get());
+            FastStatement else_statement;
+            if (if_stmt->else_statement) else_statement = compile_statement(program, if_stmt->else_statement.get());
+            return [condition, then_statement, else_statement](Interpreter& context) {
+                if (is_truthy(condition(context))) return then_statement(context);
+                if (else_statement) return else_statement(context);
+                return ExecResult::NORMAL;
+            };
+        }
+        else if (auto block_stmt = dynamic_cast<const BlockStatement*>(stmt)) {
+            std::vector<FastStatement> statements;
+            for (const auto& statement : block_stmt->statements) {
+                statements.push_back(compile_statement(program, statement.get()));
+            }
+            return [statements](Interpreter& context) {
+                for (const auto& statement : statements) {
+                    if (statement(context) == ExecResult::RETURN) return ExecResult::RETURN;
+                }
+                return ExecResult::NORMAL;
+            };
+        }
+        else if (auto ret_stmt = dynamic_cast<const ReturnStatement*>(stmt); ret_stmt && ret_stmt->values.size() == 1) {
+            FastExpression value = compile_expression(program, ret_stmt->values[0].get());
+            return [value](Interpreter& context) {
+                Value return_value = value(context);
+                context.return_registers.clear();
+                context.return_registers.push_back(std::move(return_value));
+                return ExecResult::RETURN;
+            };
+        }
+        return [stmt](Interpreter& context) { return context.execute_statement(stmt); };
+    }
+
+    static bool is_truthy(const Value& condition) {
+        return std::visit([](const auto& val) -> bool {
+            if constexpr (std::is_same_v<std::decay_t<decltype(val)>, bool>) {
+                return val;
+            } else if constexpr (std::is_arithmetic_v<std::decay_t<decltype(val)>>) {
+                return val != 0;
+            } else if constexpr (std::is_same_v<std::decay_t<decltype(val)>, std::string>) {
+                return !val.empty();
+            } else if constexpr (std::is_same_v<std::decay_t<decltype(val)>, ValueArray>) {
+                return !val.empty();
+            } else if constexpr (std::is_same_v<std::decay_t<decltype(val)>, BigInt>) {
+                return !val.is_zero();
+            } else if constexpr (std::is_same_v<std::decay_t<decltype(val)>, ValueMap>) {
+                return !val.empty();
+            } else {
+                return false;
+            }
+        }, condition.data);
+    }
+
+    // Runs the body once per element across threads. Each thread gets a worker interpreter with its
+    // own variables (the loop variable and whatever the body declares, reset every element) that reads
+    // everything else from here. The parser already made sure the body only writes its own stuff.
+    void execute_pfor(const PforStatement* pfor) {
+        auto it = variables.find(pfor->room_name);
+        if (it == variables.end()) {
+            throw std::runtime_error("Undefined room: " + pfor->room_name);
+        }
+        if (!it->second.holds<ValueArray>()) {
+            throw std::runtime_error("pfor needs a room to loop over: " + pfor->room_name);
+        }
+        if (call_depth > 0) remember_variable(pfor->room_name);
+
+        // the room is taken out while the loop runs, so a function called from the body can't
+        // read elements another thread is busy writing
+        ValueArray room = std::move(it->second.get<ValueArray>());
+        variables.erase(it);
+
+        std::exception_ptr error;
         try {
-            for (const auto& statement : program->statements) {
-                execute_statement(statement.get());
+            run_parallel(room.size(), PFOR_MIN_ELEMENTS_PER_THREAD, [&](Interpreter& worker, size_t start, size_t end) {
+                for (size_t i = start; i < end; ++i) {
+                    worker.variables.clear();
+                    worker.variables.emplace(pfor->variable_name, std::move(room[i]));
+                    worker.execute_statement(pfor->body.get());
+                    room[i] = std::move(worker.variables[pfor->variable_name]);
+                }
+            });
+        } catch (...) {
+            error = std::current_exception();
+        }
+
+        variables[pfor->room_name] = std::move(room);
+        if (error) std::rethrow_exception(error);
+    }
+
+    // Splits [0, count) over up to one thread per core (but at least min_per_thread each) and calls
+    // body(worker, start, end) for every chunk. Each thread gets a worker context that reads this
+    // one's variables. Chunks start big and shrink near the end so the threads finish together.
+    // The first error any thread hits stops the rest and is rethrown here.
+    template<typename Body>
+    void run_parallel(size_t count, size_t min_per_thread, Body body) {
+        size_t threads = std::max(1u, std::thread::hardware_concurrency());
+        threads = std::max<size_t>(1, std::min(threads, count / min_per_thread));
+
+        std::atomic<size_t> next{0};
+        std::vector<std::exception_ptr> errors(threads);
+        auto work = [&](size_t part) {
+            try {
+                Interpreter worker(this);
+                while (true) {
+                    size_t start = next.load();
+                    size_t chunk;
+                    do {
+                        if (start >= count) return;
+                        chunk = std::max<size_t>(1, (count - start) / (threads * 4));
+                    } while (!next.compare_exchange_weak(start, start + chunk));
+                    body(worker, start, std::min(start + chunk, count));
+                }
+            } catch (...) {
+                errors[part] = std::current_exception();
+                next.store(count);
             }
-        } catch (const ReturnException& ret) {
-            std::cout << "Program exited with return value: " << value_to_string(ret.value) << std::endl;
+        };
+
+        std::vector<std::thread> workers;
+        for (size_t part = 1; part < threads; ++part) {
+            workers.emplace_back(work, part);
+        }
+        work(0);
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        for (const auto& error : errors) {
+            if (error) std::rethrow_exception(error);
+        }
+    }
+
+    // pmap()/preduce() run the function on several threads at once, so it has to be a pure builtin
+    // or a top-level function that (all the way down) only calls pure builtins. Checked before
+    // anything runs. Gives back nullptr for a builtin.
+    const UserFunction* pure_function(const Value& name, const std::string& caller) const {
+        const std::string* function_name = name.get_if<std::string>();
+        if (!function_name) {
+            throw std::runtime_error(caller + "() expects a function name first");
+        }
+        const UserFunction* func = compiled->find_function(*function_name);
+        if (!func) {
+            if (PURE_BUILTINS.count(*function_name)) return nullptr;
+            throw std::runtime_error(caller + "() needs a top-level function or a pure builtin, got " + *function_name);
         }
+        std::string impure = compiled->impure_call(*function_name);
+        if (!impure.empty()) {
+            throw std::runtime_error(caller + "() can only run pure functions, " + *function_name + "() ends up calling " + impure + "()");
+        }
+        return func;
+    }
+
+    Value call_pure_function(const UserFunction* func, const std::string& name, const ValueVector& args) {
+        return func ? call_user_function(*func, args) : function_registry.call_function(name, args);
     }
+
+    // pmap("f", room): a new ROOM with f(x) for every x, worked out in parallel
+    Value parallel_map(const ValueVector& args) {
+        if (args.size() != 2 || !args[1].get_if<ValueArray>()) {
+            throw std::runtime_error("pmap() expects a function name and a ROOM");
+        }
+        const UserFunction* func = pure_function(args[0], "pmap");
+        const std::string& name = args[0].get<std::string>();
+        const ValueArray& room = args[1].get<ValueArray>();
+
+        ValueVector results(room.size());
+        run_parallel(room.size(), PFOR_MIN_ELEMENTS_PER_THREAD, [&](Interpreter& worker, size_t start, size_t end) {
+            ValueVector call_args(1);
+            for (size_t i = start; i < end; ++i) {
+                call_args[0] = room[i];
+                results[i] = worker.call_pure_function(func, name, call_args);
+            }
+        });
+        return ValueArray(std::move(results));
+    }
+
+    // preduce("f", room, init): f(...f(f(init, x0), x1)..., xn), with the ROOM cut into pieces
+    // that are reduced in parallel and then combined pairwise. f has to be associative, but init
+    // only gets used once, so it doesn't have to be an identity.
+    Value parallel_reduce(const ValueVector& args) {
+        if (args.size() != 3 || !args[1].get_if<ValueArray>()) {
+            throw std::runtime_error("preduce() expects a function name, a ROOM and a starting value");
+        }
+        const UserFunction* func = pure_function(args[0], "preduce");
+        const std::string& name = args[0].get<std::string>();
+        const ValueArray& room = args[1].get<ValueArray>();
+        if (room.empty()) return args[2];
+
+        const size_t count = room.size();
+        size_t pieces = std::max(1u, std::thread::hardware_concurrency()) * 4;
+        pieces = std::max<size_t>(1, std::min(pieces, count / PFOR_MIN_ELEMENTS_PER_THREAD));
+
+        ValueVector partials(pieces);
+        run_parallel(pieces, 1, [&](Interpreter& worker, size_t first, size_t last) {
+            ValueVector call_args(2);
+            for (size_t piece = first; piece < last; ++piece) {
+                size_t start = piece * count / pieces;
+                size_t end = (piece + 1) * count / pieces;
+                Value total = room[start];
+                for (size_t i = start + 1; i < end; ++i) {
+                    call_args[0] = std::move(total);
+                    call_args[1] = room[i];
+                    total = worker.call_pure_function(func, name, call_args);
+                }
+                partials[piece] = std::move(total);
+            }
+        });
+
+        // neighbours get combined, so the order f sees things in never changes
+        ValueVector call_args(2);
+        for (size_t step = 1; step < pieces; step *= 2) {
+            for (size_t i = 0; i + step < pieces; i += step * 2) {
+                call_args[0] = std::move(partials[i]);
+                call_args[1] = std::move(partials[i + step]);
+                partials[i] = call_pure_function(func, name, call_args);
+            }
+        }
+        call_args[0] = args[2];
+        call_args[1] = std::move(partials[0]);
+        return call_pure_function(func, name, call_args);
+    }
+
+    // var a, b = f(); takes f's return values, anything else has to give back a ROOM of the right size
+    void execute_destructuring(const DestructuringDeclaration* destructure) {
+        const size_t count = destructure->names.size();
+        auto call = dynamic_cast<const FunctionCall*>(destructure->initializer.get());
+
+        if (call && find_user_function(call->function_name)) {
+            evaluate_function_call(call);
+            // a function that hands back one ROOM gets unpacked like any other ROOM
+            if (return_registers.size() == 1 && count > 1 && return_registers[0].holds<ValueArray>()) {
+                Value room = std::move(return_registers[0]);
+                unpack_room(destructure, room);
+                return;
+            }
+            if (return_registers.size() != count) {
+                throw std::runtime_error(call->function_name + "() returned " + std::to_string(return_registers.size()) +
+                                         " values, expected " + std::to_string(count));
+            }
+            for (size_t i = 0; i < count; ++i) {
+                set_variable(destructure->names[i], std::move(return_registers[i]));
+            }
+            return;
+        }
+
+        Value value = evaluate_expression(destructure->initializer.get());
+        unpack_room(destructure, value);
+    }
+
+    void unpack_room(const DestructuringDeclaration* destructure, Value& value) {
+        const size_t count = destructure->names.size();
+        ValueArray* room = value.get_if<ValueArray>();
+        if (!room || room->size() != count) {
+            throw std::runtime_error("Expected " + std::to_string(count) + " values to unpack");
+        }
+        for (size_t i = 0; i < count; ++i) {
+            set_variable(destructure->names[i], std::move((*room)[i]));
+        }
+    }
+
+    void execute_program() {
+        run_statements(&compiled->statements(), 0);
+    }
+
+    // picks up a program where checkpoint() left it: the globals come back from the file
+    // and the rest of the script runs
+    void resume_program(const std::string& checkpoint_path) {
+        const Program* program = &compiled->statements();
+        Value state = load_document(checkpoint_path);
+        ValueMap* fields = state.get_if<ValueMap>();
+        Value* statements = fields ? fields->find(std::string("statements")) : nullptr;
+        Value* next = fields ? fields->find(std::string("next")) : nullptr;
+        Value* saved_variables = fields ? fields->find(std::string("variables")) : nullptr;
+        if (!statements || !next || !saved_variables || !statements->get_if<int>() || !next->get_if<int>() ||
+            !saved_variables->get_if<ValueMap>()) {
+            throw std::runtime_error(checkpoint_path + " isn't a checkpoint file");
+        }
+        size_t first = static_cast<size_t>(next->get<int>());
+        if (static_cast<size_t>(statements->get<int>()) != program->statements.size() || first > program->statements.size()) {
+            throw std::runtime_error(checkpoint_path + " was written by a different version of this script");
+        }
+
+        ValueMap& globals = saved_variables->get<ValueMap>();
+        for (size_t i = 0; i < globals.size(); ++i) {
+            variables[globals.keys[i].get<std::string>()] = std::move(globals.values[i]);
+        }
+        run_statements(program, first);
+    }
+
+    void run_statements(const Program* program, size_t first) {
+        running_program = program;
+        for (size_t index = first; index < program->statements.size(); ++index) {
+            running_statement = index;
+            if (execute_statement(program->statements[index].get()) == ExecResult::RETURN) {
+                std::string returned;
+                for (size_t i = 0; i < return_registers.size(); ++i) {
+                    if (i > 0) returned += ", ";
+                    returned += value_to_string(return_registers[i]);
+                }
+                program_output().write("Program exited with return value: " + returned + "\n");
+                break;
+            }
+        }
+        running_program = nullptr;
+    }
+
+    // only as a statement of its own at the top level: then the globals are the whole state
+    // and "the statement after this one" is all the program counter there is
+    void write_checkpoint(const std::string& path) {
+        const ExpressionStatement* statement = nullptr;
+        if (running_program && call_depth == 0) {
+            statement = dynamic_cast<const ExpressionStatement*>(running_program->statements[running_statement].get());
+        }
+        auto call = statement ? dynamic_cast<const FunctionCall*>(statement->expression.get()) : nullptr;
+        if (!call || call->function_name != "checkpoint") {
+            throw std::runtime_error("checkpoint() has to be a statement of its own at the top level of the script");
+        }
+        // none of these come back on --resume, and the handles the script holds for them would point at nothing
+        if (task_scheduler->busy()) {
+            throw std::runtime_error("checkpoint() can't save while tasks are running or haven't been awaited");
+        }
+        if (isolate_scheduler->live() > 0) {
+            throw std::runtime_error("checkpoint() can't save while isolates are running, isolate_stop() them first");
+        }
+        if (event_loop->pending() > 0) {
+            throw std::runtime_error("checkpoint() can't save while timers are set, let run() finish or clear them first");
+        }
+
+        // write next to it and rename, so a crash halfway through doesn't eat the last good checkpoint
+        std::string temp_path = path + ".tmp";
+        write_document(temp_path, encode_checkpoint(running_program->statements.size(), running_statement + 1, variables),
+                       "checkpoint");
+#ifdef _WIN32
+        std::remove(path.c_str());
+#endif
+        if (std::rename(temp_path.c_str(), path.c_str()) != 0) {
+            throw std::runtime_error("checkpoint(): failed to replace " + path);
+        }
+    }
+
     void print_variables() {
         std::cout << "\n=== VARIABLES ===" << std::endl;
         for (const auto& [name, value] : variables) {
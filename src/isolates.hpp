@@ -0,0 +1,164 @@
+#pragma once
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <memory>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include "parser/functions.hpp"
+#include "builtins/handles.hpp"
+#include "thread_pool.hpp"
+
+// messages an isolate handles before giving its thread to the next one with mail
+const size_t ISOLATE_BATCH = 256;
+const size_t ISOLATE_THREAD_LIMIT = 256;
+
+/*
+    One actor: a handler, the state it threads through, and a mailbox. Sending never blocks,
+    the message just goes on the end of the mailbox and the isolate gets queued on the pool if
+    it wasn't already. Only one thread ever runs a given isolate, so its state needs no locking,
+    and thousands of them share however many threads the pool has.
+*/
+class Isolate {
+public:
+    // handler(state, message) gives back the new state
+    using Handler = std::function<Value(const ValueVector&)>;
+
+private:
+    Handler handler;
+    Value state;
+    std::exception_ptr error;
+
+    std::mutex mutex;
+    std::condition_variable idle;
+    std::vector<Value> mailbox;
+    std::vector<Value> batch;  // only touched by whoever is running the isolate
+    bool scheduled = false;
+
+public:
+    Isolate(Handler handler, Value initial_state) : handler(std::move(handler)), state(std::move(initial_state)) {}
+
+    // true if the isolate was idle and the caller has to get it running
+    bool post(Value message) {
+        std::lock_guard<std::mutex> lock(mutex);
+        mailbox.push_back(std::move(message));
+        if (scheduled) return false;
+        scheduled = true;
+        return true;
+    }
+
+    // Handles up to ISOLATE_BATCH messages. True if there's more mail and it should go back on the
+    // pool, false once it's gone idle. After an error the rest of the mail is thrown away.
+    bool run() {
+        size_t handled = 0;
+        ValueVector args(2);
+        while (handled < ISOLATE_BATCH) {
+            if (batch.empty()) {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (mailbox.empty()) {
+                    scheduled = false;
+                    idle.notify_all();
+                    return false;
+                }
+                std::swap(batch, mailbox);
+                std::reverse(batch.begin(), batch.end());  // popped off the back, oldest first
+            }
+            if (error) {
+                batch.clear();
+                continue;
+            }
+            args[0] = std::move(state);
+            args[1] = std::move(batch.back());
+            batch.pop_back();
+            ++handled;
+            try {
+                state = handler(args);
+            } catch (...) {
+                error = std::current_exception();
+            }
+        }
+        return true;
+    }
+
+    // the state once everything sent so far has been handled, or the handler's error
+    Value settle() {
+        std::unique_lock<std::mutex> lock(mutex);
+        idle.wait(lock, [this] { return !scheduled; });
+        if (error) std::rethrow_exception(error);
+        return state;
+    }
+};
+
+// every isolate a run has made, and the threads they take turns on
+class IsolateScheduler {
+private:
+    HandleTable<Isolate> isolates;
+    std::mutex mutex;
+    std::condition_variable idle;
+    size_t running = 0;
+    ThreadPool pool;  // last, so its threads are joined before anything they use goes
+
+    static inline thread_local const Isolate* current = nullptr;  // the one this thread is running
+
+    void schedule(std::shared_ptr<Isolate> isolate) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ++running;
+        }
+        pool.submit([this, isolate]() mutable {
+            current = isolate.get();
+            bool more = isolate->run();
+            current = nullptr;
+            if (more) schedule(isolate);
+            // a stopped isolate has to go (and take its context with it) before this counts as idle
+            isolate.reset();
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--running == 0) idle.notify_all();
+        });
+    }
+
+public:
+    // handlers can block on channels, so the pool grows past one thread per core if it has to
+    IsolateScheduler() : pool(std::max(1u, std::thread::hardware_concurrency()), ISOLATE_THREAD_LIMIT) {}
+
+    int create(Isolate::Handler handler, Value initial_state) {
+        return isolates.add(std::make_shared<Isolate>(std::move(handler), std::move(initial_state)));
+    }
+
+    void send(const Value& handle, Value message) {
+        auto isolate = isolates.get(handle, "tell");
+        if (isolate->post(std::move(message))) schedule(isolate);
+    }
+
+    Value state(const Value& handle, const std::string& function_name) {
+        auto isolate = isolates.get(handle, function_name);
+        if (isolate.get() == current) {
+            throw std::runtime_error(function_name + "() can't wait on the isolate it's running in");
+        }
+        return isolate->settle();
+    }
+
+    // waits for its mail to be handled, then forgets it
+    Value stop(const Value& handle) {
+        Value final_state = state(handle, "isolate_stop");
+        isolates.remove(handle, "isolate_stop");
+        return final_state;
+    }
+
+    // isolates that haven't been stopped yet
+    size_t live() {
+        return isolates.size();
+    }
+
+    void wait_idle() {
+        std::unique_lock<std::mutex> lock(mutex);
+        idle.wait(lock, [this] { return running == 0; });
+    }
+
+    // isolates hold contexts that hold this scheduler, dropping them breaks the cycle
+    void clear() {
+        isolates.clear();
+    }
+};
@@ -15,7 +15,7 @@ enum TokenType{
 
     //keywords
     IF, THEN, RET, WHILE, FOR, ELSE,
-    CONTINUE, BREAK, IN, ROOM, VAR, FUNC,
+    CONTINUE, BREAK, IN, ROOM, VAR, FUNC, PFOR, SPAWN, AWAIT,
 
     //arithmetic
     PLUS, MINUS, EQUALS, STAR, SLASH, CARET,
@@ -113,6 +113,9 @@ std::vector<Token> lexer(std::string line){
             else if(word == "then") tokens.push_back(Token(THEN, word));
             else if(word == "ret") tokens.push_back(Token(RET, word));
             else if(word == "for") tokens.push_back(Token(FOR, word));
+            else if(word == "pfor") tokens.push_back(Token(PFOR, word));
+            else if(word == "spawn") tokens.push_back(Token(SPAWN, word));
+            else if(word == "await") tokens.push_back(Token(AWAIT, word));
             else if(word == "else") tokens.push_back(Token(ELSE, word));
             else if(word == "continue") tokens.push_back(Token(CONTINUE, word));
             else if(word == "break") tokens.push_back(Token(BREAK, word));
@@ -4,26 +4,38 @@
 #include <fstream>
 #include <algorithm>
 #include <cctype>
-#include "parser/parser.hpp"
-#include "lexer.hpp"
+#include <cstdlib>
+#include "program.hpp"
 #include "interpreter.hpp"
+#include "output.hpp"
 
 /*
     Just a few directions on how to compile:
 
     1. make a .ast file in the worspace folder
     2. write some codeeeee
-    3. go to the main.cpp file and change the directory to the name of your file
+    3. run it with the path of your file (asterisk workspace/my_file.ast), with no path it runs workspace/example.ast
+       (add --resume my_checkpoint to carry on from a checkpoint() instead of starting over)
     4. if you need documentation, there's a documentation file for you with the .md file
 */
 
-int main() {
+int main(int argc, char* argv[]) {
 
-    std::ifstream file("workspace/example.ast");
+    std::string path = "workspace/example.ast";
+    std::string resume_path;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--resume" && i + 1 < argc) {
+            resume_path = argv[++i];
+        } else {
+            path = arg;
+        }
+    }
+    std::ifstream file(path);
     std::string line;
 
     if (!file.is_open()) {
-        std::cerr << "Failed to open file." << std::endl;
+        std::cerr << "Failed to open file: " << path << std::endl;
         return 1;
     }
 
@@ -36,15 +48,25 @@ int main() {
     file.close();
 
     try {
-        std::vector<Token> tokens = lexer(content);
-
-        Parser parser(tokens);
-        auto program = parser.parse_program();
+        auto program = CompiledProgram::compile(content, "plugins");
 
-        Interpreter interpreter;
-        interpreter.execute_program(program.get());
-        
+        Interpreter interpreter(program);
+        try {
+            if (resume_path.empty()) {
+                interpreter.execute_program();
+            } else {
+                interpreter.resume_program(resume_path);
+            }
+        } catch (const std::exception& e) {
+            // Has to be reported in here: leaving this scope waits for every task the script spawned,
+            // and one of them might be stuck on a channel nobody is going to send to anymore. A run
+            // that failed doesn't wait for its tasks, it just ends.
+            program_output().flush();
+            std::cerr << "Error: " << e.what() << std::endl;
+            std::_Exit(1);
+        }
     } catch (const std::exception& e) {
+        program_output().flush();
         std::cerr << "Error: " << e.what() << std::endl;
         return 1;
     }
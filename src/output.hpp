@@ -0,0 +1,181 @@
+#pragma once
+#include <atomic>
+#include <string>
+#include <algorithm>
+#include <thread>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+/*
+    Everything the program prints goes through here.
+
+    On a terminal it's just std::cout. When stdout is a file or a pipe, writes get copied into a
+    ring buffer and a writer thread does the actual write(2) calls, so a slow disk or a reader
+    that isn't keeping up doesn't stall the interpreter. If the buffer fills up the interpreter
+    waits for room, and flush() (called on exit and before errors get printed) waits until
+    everything is out.
+*/
+class ProgramOutput {
+private:
+    static const size_t BUFFER_SIZE = 1 << 22;
+    // the writer only gets woken once this much is waiting, smaller bits go out on its next timeout
+    static const size_t WAKE_THRESHOLD = 1 << 16;
+    static constexpr std::chrono::milliseconds WRITER_TIMEOUT{20};
+
+    bool threaded = false;
+
+    // single producer / single consumer ring, head and tail only ever grow.
+    // head/tail stores are seq_cst so they pair up with the *_waiting flags below
+    std::unique_ptr<char[]> ring;
+    std::atomic<size_t> head{0};  // written by the producer
+    std::atomic<size_t> tail{0};  // written by the writer thread
+    std::mutex producer_mutex;    // more than one interpreter thread can print, only one gets to be "the" producer at a time
+
+    // sleeping when there's nothing to do, the flags let the other side skip the lock when nobody's asleep
+    std::mutex sleep_mutex;
+    std::condition_variable data_ready;
+    std::condition_variable space_ready;
+    std::atomic<bool> writer_waiting{false};
+    std::atomic<bool> producer_waiting{false};
+    std::atomic<bool> stopping{false};
+    std::thread writer;
+
+    static bool stdout_is_terminal() {
+#ifdef _WIN32
+        return _isatty(_fileno(stdout)) != 0;
+#else
+        return isatty(1) != 0;
+#endif
+    }
+
+    static void write_fully(const char* data, size_t length) {
+#ifdef _WIN32
+        std::fwrite(data, 1, length, stdout);
+        std::fflush(stdout);
+#else
+        while (length > 0) {
+            ssize_t written = ::write(1, data, length);
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                return;  // reader went away, nothing sensible left to do with the output
+            }
+            data += written;
+            length -= static_cast<size_t>(written);
+        }
+#endif
+    }
+
+    void wake(std::condition_variable& condition, std::atomic<bool>& waiting) {
+        if (waiting.load()) {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+            condition.notify_all();
+        }
+    }
+
+    void drain() {
+        while (true) {
+            size_t end = head.load(std::memory_order_acquire);
+            size_t start = tail.load(std::memory_order_relaxed);
+            if (start == end) {
+                if (stopping.load()) return;
+                std::unique_lock<std::mutex> lock(sleep_mutex);
+                writer_waiting.store(true);
+                data_ready.wait_for(lock, WRITER_TIMEOUT, [this, start] { return head.load() != start || stopping.load(); });
+                writer_waiting.store(false);
+                continue;
+            }
+            // up to the end of the ring in one go, the wrapped part on the next loop
+            size_t offset = start % BUFFER_SIZE;
+            size_t length = std::min(end - start, BUFFER_SIZE - offset);
+            write_fully(ring.get() + offset, length);
+            tail.store(start + length);
+            wake(space_ready, producer_waiting);
+        }
+    }
+
+public:
+    ProgramOutput() {
+        if (stdout_is_terminal()) return;
+        threaded = true;
+        ring.reset(new char[BUFFER_SIZE]);
+        std::cout.flush();
+        writer = std::thread(&ProgramOutput::drain, this);
+    }
+
+    ProgramOutput(const ProgramOutput&) = delete;
+    ProgramOutput& operator=(const ProgramOutput&) = delete;
+
+    ~ProgramOutput() {
+        if (!threaded) return;
+        stopping.store(true);
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+            data_ready.notify_all();
+        }
+        writer.join();  // drain() only stops once the ring is empty
+    }
+
+    void write(const char* data, size_t length) {
+        if (!threaded) {
+            std::cout.write(data, static_cast<std::streamsize>(length));
+            return;
+        }
+        std::lock_guard<std::mutex> producer_lock(producer_mutex);
+        while (length > 0) {
+            size_t start = head.load(std::memory_order_relaxed);
+            size_t free_space = BUFFER_SIZE - (start - tail.load(std::memory_order_acquire));
+            if (free_space == 0) {
+                std::unique_lock<std::mutex> lock(sleep_mutex);
+                producer_waiting.store(true);
+                space_ready.wait(lock, [this, start] { return start - tail.load() < BUFFER_SIZE; });
+                producer_waiting.store(false);
+                continue;
+            }
+            size_t offset = start % BUFFER_SIZE;
+            size_t chunk = std::min({length, free_space, BUFFER_SIZE - offset});
+            std::memcpy(ring.get() + offset, data, chunk);
+            head.store(start + chunk);
+            if (start + chunk - tail.load() >= WAKE_THRESHOLD) {
+                wake(data_ready, writer_waiting);
+            }
+            data += chunk;
+            length -= chunk;
+        }
+    }
+
+    void write(const std::string& text) {
+        write(text.data(), text.size());
+    }
+
+    // blocks until everything written so far has reached stdout
+    void flush() {
+        if (!threaded) {
+            std::cout.flush();
+            return;
+        }
+        std::lock_guard<std::mutex> producer_lock(producer_mutex);
+        size_t end = head.load();
+        wake(data_ready, writer_waiting);
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        producer_waiting.store(true);
+        space_ready.wait(lock, [this, end] { return tail.load() == end; });
+        producer_waiting.store(false);
+    }
+};
+
+ProgramOutput& program_output() {
+    static ProgramOutput output;
+    return output;
+}
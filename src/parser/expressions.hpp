@@ -132,6 +132,30 @@ struct FunctionCall : public Expression {
     }
 };
 
+// spawn f(x): starts the call as a task and gives back its handle
+struct SpawnExpression : public Expression {
+    std::unique_ptr<FunctionCall> call;
+
+    SpawnExpression(std::unique_ptr<FunctionCall> c) : call(std::move(c)) {}
+
+    void print(int indent = 0) const override {
+        std::cout << std::string(indent, ' ') << "SpawnExpression:" << std::endl;
+        call->print(indent + 2);
+    }
+};
+
+// await t: waits for the task and gives back what it returned
+struct AwaitExpression : public Expression {
+    std::unique_ptr<Expression> task;
+
+    AwaitExpression(std::unique_ptr<Expression> t) : task(std::move(t)) {}
+
+    void print(int indent = 0) const override {
+        std::cout << std::string(indent, ' ') << "AwaitExpression:" << std::endl;
+        task->print(indent + 2);
+    }
+};
+
 struct RoomLiteral : public Expression {
     std::vector<std::unique_ptr<Expression>> elements;
 
@@ -6,6 +6,9 @@
 #include <cmath>
 #include <iostream>
 #include <memory>
+#include <charconv>
+#include <cstdint>
+#include "../bigint.hpp"
 
 // Forward declaration
 struct Value;
@@ -28,9 +31,25 @@ struct ValueArray {
     auto end() const { return elements.end(); }
 };
 
+// Keyed ROOM (what group_by and friends give back). Keeps insertion order, and keys
+// compare by type and value (ValueKeyHash/ValueKeyEqual) so 1, 1.0 and "1" stay different keys.
+struct ValueMap {
+    std::vector<Value> keys;
+    std::vector<Value> values;
+    std::unordered_multimap<size_t, size_t> index;  // key hash -> position in keys
+
+    size_t size() const { return keys.size(); }
+    bool empty() const { return keys.empty(); }
+
+    size_t position(const Value& key) const;  // SIZE_MAX if it isn't there
+    Value* find(const Value& key);
+    const Value* find(const Value& key) const;
+    void set(Value key, Value value);
+};
+
 // Now define Value using the array struct
 struct Value {
-    std::variant<int, float, std::string, bool, ValueArray> data;
+    std::variant<int, float, std::string, bool, ValueArray, BigInt, ValueMap> data;
 
     Value() : data(0) {}
     Value(int v) : data(v) {}
@@ -39,6 +58,10 @@ struct Value {
     Value(bool v) : data(v) {}
     Value(const ValueArray& v) : data(v) {}
     Value(ValueArray&& v) : data(std::move(v)) {}
+    Value(const BigInt& v) : data(v) {}
+    Value(BigInt&& v) : data(std::move(v)) {}
+    Value(const ValueMap& v) : data(v) {}
+    Value(ValueMap&& v) : data(std::move(v)) {}
 
     template<typename T>
     bool holds() const { return std::holds_alternative<T>(data); }
@@ -58,6 +81,88 @@ struct Value {
 
 using ValueVector = std::vector<Value>;
 
+// Hashing for scalar Values (ints, floats, strings, bools, big ints), used as hash table keys
+// by ValueMap and group_by. 1 and 1.0 are different keys.
+struct ValueKeyHash {
+    size_t operator()(const Value* v) const {
+        size_t type_hash = v->data.index() * 0x9e3779b97f4a7c15ULL;
+        return type_hash ^ std::visit([](const auto& x) -> size_t {
+            using T = std::decay_t<decltype(x)>;
+            if constexpr (std::is_same_v<T, BigInt>) {
+                return std::hash<std::string>()(x.to_string());
+            } else if constexpr (std::is_same_v<T, ValueArray> || std::is_same_v<T, ValueMap>) {
+                throw std::runtime_error("room keys can't be rooms");
+            } else {
+                return std::hash<T>()(x);
+            }
+        }, v->data);
+    }
+};
+
+struct ValueKeyEqual {
+    bool operator()(const Value* a, const Value* b) const {
+        if (a->data.index() != b->data.index()) return false;
+        return std::visit([b](const auto& x) -> bool {
+            using T = std::decay_t<decltype(x)>;
+            if constexpr (std::is_same_v<T, ValueArray> || std::is_same_v<T, ValueMap>) {
+                return false;
+            } else {
+                return x == b->get<T>();
+            }
+        }, a->data);
+    }
+};
+
+// ints and bools are exact and can be promoted to BigInt, floats can't
+template<typename T>
+constexpr bool is_integer_v = std::is_same_v<T, int> || std::is_same_v<T, bool> || std::is_same_v<T, BigInt>;
+
+template<typename T>
+constexpr bool is_numeric_v = std::is_arithmetic_v<T> || std::is_same_v<T, BigInt>;
+
+template<typename T>
+BigInt to_bigint(const T& v) {
+    if constexpr (std::is_same_v<T, BigInt>) return v;
+    else return BigInt(static_cast<int64_t>(v));
+}
+
+template<typename T>
+float to_float(const T& v) {
+    if constexpr (std::is_same_v<T, BigInt>) return static_cast<float>(v.to_double());
+    else return static_cast<float>(v);
+}
+
+// BigInt results that fit go back to plain ints so the fast path kicks in again
+Value normalize_integer(BigInt v) {
+    if (v.fits_int()) return v.to_int();
+    return Value(std::move(v));
+}
+
+// shortest text that reads back as the same float (std::to_string always prints 6 decimals)
+void append_float(std::string& out, float value) {
+    char buffer[32];
+    auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    out.append(buffer, result.ptr);
+}
+
+void append_int(std::string& out, int value) {
+    char buffer[16];
+    auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    out.append(buffer, result.ptr);
+}
+
+double value_to_double(const Value& val, const std::string& function_name) {
+    return std::visit([&function_name](const auto& v) -> double {
+        if constexpr (std::is_same_v<std::decay_t<decltype(v)>, BigInt>) {
+            return v.to_double();
+        } else if constexpr (std::is_arithmetic_v<std::decay_t<decltype(v)>>) {
+            return static_cast<double>(v);
+        } else {
+            throw std::runtime_error(function_name + "() requires numeric values");
+        }
+    }, val.data);
+}
+
 std::string value_to_string(const Value& val) {
     return std::visit([](const auto& v) -> std::string {
         if constexpr (std::is_same_v<std::decay_t<decltype(v)>, bool>) {
@@ -72,23 +177,70 @@ std::string value_to_string(const Value& val) {
             }
             result += "]";
             return result;
+        } else if constexpr (std::is_same_v<std::decay_t<decltype(v)>, BigInt>) {
+            return v.to_string();
+        } else if constexpr (std::is_same_v<std::decay_t<decltype(v)>, ValueMap>) {
+            std::string result = "{";
+            for (size_t i = 0; i < v.size(); ++i) {
+                if (i > 0) result += ", ";
+                result += value_to_string(v.keys[i]) + ": " + value_to_string(v.values[i]);
+            }
+            result += "}";
+            return result;
         } else {
             return std::to_string(v);
         }
     }, val.data);
 }
 
+size_t ValueMap::position(const Value& key) const {
+    if (key.holds<ValueArray>() || key.holds<ValueMap>()) return SIZE_MAX;
+    auto range = index.equal_range(ValueKeyHash()(&key));
+    for (auto it = range.first; it != range.second; ++it) {
+        if (ValueKeyEqual()(&keys[it->second], &key)) return it->second;
+    }
+    return SIZE_MAX;
+}
+
+Value* ValueMap::find(const Value& key) {
+    size_t i = position(key);
+    return i == SIZE_MAX ? nullptr : &values[i];
+}
+
+const Value* ValueMap::find(const Value& key) const {
+    size_t i = position(key);
+    return i == SIZE_MAX ? nullptr : &values[i];
+}
+
+void ValueMap::set(Value key, Value value) {
+    if (key.holds<ValueArray>() || key.holds<ValueMap>()) {
+        throw std::runtime_error("room keys can't be rooms");
+    }
+    size_t i = position(key);
+    if (i != SIZE_MAX) {
+        values[i] = std::move(value);
+        return;
+    }
+    index.emplace(ValueKeyHash()(&key), keys.size());
+    keys.push_back(std::move(key));
+    values.push_back(std::move(value));
+}
+
 using BuiltinFunction = std::function<Value(const ValueVector&)>;
 
 class FunctionRegistry {
 private:
     std::unordered_map<std::string, BuiltinFunction> builtin_functions;
+    const FunctionRegistry* shared = nullptr;  // looked in when a name isn't in here
 
 public:
     FunctionRegistry() {
         register_builtin_functions();
     }
 
+    // starts empty, everything it doesn't have itself comes out of shared
+    explicit FunctionRegistry(const FunctionRegistry* shared_registry) : shared(shared_registry) {}
+
     void register_builtin_functions() {
         builtin_functions["print"] = [](const ValueVector& args) -> Value {
             if (args.size() != 1) {
@@ -105,6 +257,8 @@ public:
             return std::visit([](const auto& val) -> Value {
                 if constexpr (std::is_arithmetic_v<std::decay_t<decltype(val)>>) {
                     return static_cast<int>(std::round(val));
+                } else if constexpr (std::is_same_v<std::decay_t<decltype(val)>, BigInt>) {
+                    return val;
                 } else {
                     throw std::runtime_error("round() requires numeric argument");
                 }
@@ -118,6 +272,8 @@ public:
             return std::visit([](const auto& val) -> Value {
                 if constexpr (std::is_arithmetic_v<std::decay_t<decltype(val)>>) {
                     return static_cast<int>(std::floor(val));
+                } else if constexpr (std::is_same_v<std::decay_t<decltype(val)>, BigInt>) {
+                    return val;
                 } else {
                     throw std::runtime_error("floor() requires numeric argument");
                 }
@@ -131,6 +287,8 @@ public:
             return std::visit([](const auto& val) -> Value {
                 if constexpr (std::is_arithmetic_v<std::decay_t<decltype(val)>>) {
                     return static_cast<int>(std::ceil(val));
+                } else if constexpr (std::is_same_v<std::decay_t<decltype(val)>, BigInt>) {
+                    return val;
                 } else {
                     throw std::runtime_error("ceil() requires numeric argument");
                 }
@@ -144,6 +302,8 @@ public:
             return std::visit([](const auto& val) -> Value {
                 if constexpr (std::is_arithmetic_v<std::decay_t<decltype(val)>>) {
                     return std::abs(val);
+                } else if constexpr (std::is_same_v<std::decay_t<decltype(val)>, BigInt>) {
+                    return val.abs();
                 } else {
                     throw std::runtime_error("abs() requires numeric argument");
                 }
@@ -234,6 +394,8 @@ public:
             }
             if (auto array = args[0].get_if<ValueArray>()) {
                 return static_cast<int>(array->size());
+            } else if (auto map = args[0].get_if<ValueMap>()) {
+                return static_cast<int>(map->size());
             } else if (auto str = args[0].get_if<std::string>()) {
                 return static_cast<int>(str->size());
             } else {
@@ -263,17 +425,43 @@ public:
 
             return ValueArray(std::vector<Value>(args[0].get<ValueArray>().begin() + start, args[0].get<ValueArray>().begin() + end));
         };
+
+        builtin_functions["keys"] = [](const ValueVector& args) -> Value {
+            if (args.size() != 1) {
+                throw std::runtime_error("keys() expects exactly 1 argument");
+            }
+            if (!args[0].get_if<ValueMap>()) {
+                throw std::runtime_error("keys() requires a keyed room");
+            }
+            return ValueArray(args[0].get<ValueMap>().keys);
+        };
+
+        builtin_functions["has"] = [](const ValueVector& args) -> Value {
+            if (args.size() != 2) {
+                throw std::runtime_error("has() expects exactly 2 arguments");
+            }
+            if (!args[0].get_if<ValueMap>()) {
+                throw std::runtime_error("has() requires a keyed room as first argument");
+            }
+            return args[0].get<ValueMap>().find(args[1]) != nullptr;
+        };
     }
 
-    Value call_function(const std::string& name, const ValueVector& args) {
-        auto it = builtin_functions.find(name);
-        if (it != builtin_functions.end()) {
-            return it->second(args);
+    Value call_function(const std::string& name, const ValueVector& args) const {
+        if (const BuiltinFunction* function = find_function(name)) {
+            return (*function)(args);
         }
         throw std::runtime_error("Unknown function: " + name);
     }
+    // for looking a builtin up once and calling it many times
+    const BuiltinFunction* find_function(const std::string& name) const {
+        auto it = builtin_functions.find(name);
+        if (it != builtin_functions.end()) return &it->second;
+        return shared ? shared->find_function(name) : nullptr;
+    }
+
     bool function_exists(const std::string& name) const {
-        return builtin_functions.find(name) != builtin_functions.end();
+        return find_function(name) != nullptr;
     }
 
     void register_function(const std::string& name, BuiltinFunction func) {
@@ -282,6 +470,7 @@ public:
 
     std::vector<std::string> get_function_names() const {
         std::vector<std::string> names;
+        if (shared) names = shared->get_function_names();
         for (const auto& pair : builtin_functions) {
             names.push_back(pair.first);
         }
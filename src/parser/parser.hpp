@@ -3,6 +3,7 @@
 #include <string>
 #include <memory>
 #include <stdexcept>
+#include <algorithm>
 #include "../lexer.hpp"
 #include "expressions.hpp"
 #include "statements.hpp"
@@ -192,6 +193,20 @@ struct Parser {
             expect(TokenType::CLOSE_PAREN);
             return std::make_unique<FunctionCall>(name, std::move(arguments));
         }
+        case TokenType::SPAWN: {
+            advance();
+            auto expr = parse_primary();
+            auto call = dynamic_cast<FunctionCall*>(expr.get());
+            if (!call) {
+                throw std::runtime_error("spawn needs a function call, like spawn f(x)");
+            }
+            expr.release();
+            return std::make_unique<SpawnExpression>(std::unique_ptr<FunctionCall>(call));
+        }
+        case TokenType::AWAIT: {
+            advance();
+            return std::make_unique<AwaitExpression>(parse_primary());
+        }
         case TokenType::ROOM_IDENTIFIER: {
             std::string name = tok.value;
             advance();
@@ -219,6 +234,21 @@ struct Parser {
         
         std::string name = current_token().value;
         advance();
+
+        if (current_token().type == TokenType::COMMA) {
+            std::vector<std::string> names = {name};
+            while (match(TokenType::COMMA)) {
+                if (current_token().type != TokenType::IDENTIFIER && current_token().type != TokenType::ROOM_IDENTIFIER) {
+                    throw std::runtime_error("Expected identifier after ','");
+                }
+                names.push_back(current_token().value);
+                advance();
+            }
+            expect(TokenType::EQUALS);
+            auto initializer = parse_expression(0);
+            expect(TokenType::SEMICOLON);
+            return std::make_unique<DestructuringDeclaration>(std::move(names), std::move(initializer));
+        }
         
         std::unique_ptr<Expression> initializer = nullptr;
         if (match(TokenType::EQUALS)) {
@@ -255,6 +285,110 @@ struct Parser {
         
         return std::make_unique<WhileStatement>(std::move(condition), std::move(body));
     }
+    std::unique_ptr<Statement> parse_pfor_statement() {
+        expect(TokenType::PFOR);
+        expect(TokenType::OPEN_PAREN);
+        if (current_token().type != TokenType::IDENTIFIER) {
+            throw std::runtime_error("Expected a variable name after 'pfor ('");
+        }
+        std::string var_name = current_token().value;
+        advance();
+        expect(TokenType::IN);
+        if (current_token().type != TokenType::ROOM_IDENTIFIER) {
+            throw std::runtime_error("pfor can only loop over a ROOM variable");
+        }
+        std::string room_name = current_token().value;
+        advance();
+        expect(TokenType::CLOSE_PAREN);
+
+        auto body = parse_statement();
+
+        std::vector<std::string> locals = {var_name};
+        check_pfor_statement(body.get(), room_name, locals);
+        return std::make_unique<PforStatement>(var_name, room_name, std::move(body));
+    }
+
+    // Iterations run at the same time, so the body may only write its own element (the loop
+    // variable) and variables it declares itself, and may not touch the ROOM being looped over.
+    // Everything else it can read. Caught here so a racy loop never starts.
+    void check_pfor_statement(const Statement* stmt, const std::string& room_name, std::vector<std::string>& locals) {
+        auto is_local = [&locals](const std::string& name) {
+            return std::find(locals.begin(), locals.end(), name) != locals.end();
+        };
+
+        if (auto var_decl = dynamic_cast<const VariableDeclaration*>(stmt)) {
+            if (var_decl->initializer) check_pfor_expression(var_decl->initializer.get(), room_name);
+            locals.push_back(var_decl->name);
+        } else if (auto destructure = dynamic_cast<const DestructuringDeclaration*>(stmt)) {
+            check_pfor_expression(destructure->initializer.get(), room_name);
+            locals.insert(locals.end(), destructure->names.begin(), destructure->names.end());
+        } else if (auto assign = dynamic_cast<const AssignmentStatement*>(stmt)) {
+            if (!is_local(assign->variable_name)) {
+                throw std::runtime_error("pfor body can't assign " + assign->variable_name +
+                                         ", only the loop variable and variables declared inside the loop");
+            }
+            check_pfor_expression(assign->value.get(), room_name);
+        } else if (auto room_assign = dynamic_cast<const RoomAssignmentStatement*>(stmt)) {
+            if (!is_local(room_assign->room_name)) {
+                throw std::runtime_error("pfor body can't assign into " + room_assign->room_name +
+                                         ", only the loop variable and variables declared inside the loop");
+            }
+            check_pfor_expression(room_assign->index.get(), room_name);
+            check_pfor_expression(room_assign->value.get(), room_name);
+        } else if (auto expr_stmt = dynamic_cast<const ExpressionStatement*>(stmt)) {
+            check_pfor_expression(expr_stmt->expression.get(), room_name);
+        } else if (auto if_stmt = dynamic_cast<const IfStatement*>(stmt)) {
+            check_pfor_expression(if_stmt->condition.get(), room_name);
+            check_pfor_statement(if_stmt->then_statement.get(), room_name, locals);
+            if (if_stmt->else_statement) check_pfor_statement(if_stmt->else_statement.get(), room_name, locals);
+        } else if (auto while_stmt = dynamic_cast<const WhileStatement*>(stmt)) {
+            check_pfor_expression(while_stmt->condition.get(), room_name);
+            check_pfor_statement(while_stmt->body.get(), room_name, locals);
+        } else if (auto block = dynamic_cast<const BlockStatement*>(stmt)) {
+            for (const auto& statement : block->statements) {
+                check_pfor_statement(statement.get(), room_name, locals);
+            }
+        } else if (dynamic_cast<const ReturnStatement*>(stmt)) {
+            throw std::runtime_error("ret isn't allowed inside a pfor body");
+        } else if (dynamic_cast<const FunctionDeclaration*>(stmt)) {
+            throw std::runtime_error("functions can't be declared inside a pfor body");
+        } else if (dynamic_cast<const PforStatement*>(stmt)) {
+            throw std::runtime_error("pfor loops can't be nested");
+        }
+    }
+
+    void check_pfor_expression(const Expression* expr, const std::string& room_name) {
+        if (auto identifier = dynamic_cast<const Identifier*>(expr)) {
+            if (identifier->name == room_name) {
+                throw std::runtime_error("pfor body can't use " + room_name + " while it's being looped over, use the loop variable");
+            }
+        } else if (auto access = dynamic_cast<const RoomAccess*>(expr)) {
+            if (access->room_name == room_name) {
+                throw std::runtime_error("pfor body can't use " + room_name + " while it's being looped over, use the loop variable");
+            }
+            check_pfor_expression(access->index.get(), room_name);
+        } else if (auto binary = dynamic_cast<const BinaryExpression*>(expr)) {
+            check_pfor_expression(binary->left.get(), room_name);
+            check_pfor_expression(binary->right.get(), room_name);
+        } else if (auto unary = dynamic_cast<const UnaryExpression*>(expr)) {
+            check_pfor_expression(unary->operand.get(), room_name);
+        } else if (auto paren = dynamic_cast<const ParenthesizedExpression*>(expr)) {
+            check_pfor_expression(paren->expression.get(), room_name);
+        } else if (auto call = dynamic_cast<const FunctionCall*>(expr)) {
+            for (const auto& arg : call->arguments) {
+                check_pfor_expression(arg.get(), room_name);
+            }
+        } else if (auto room = dynamic_cast<const RoomLiteral*>(expr)) {
+            for (const auto& element : room->elements) {
+                check_pfor_expression(element.get(), room_name);
+            }
+        } else if (auto spawn = dynamic_cast<const SpawnExpression*>(expr)) {
+            check_pfor_expression(spawn->call.get(), room_name);
+        } else if (auto await = dynamic_cast<const AwaitExpression*>(expr)) {
+            check_pfor_expression(await->task.get(), room_name);
+        }
+    }
+
     std::unique_ptr<Statement> parse_function_declaration() {
         expect(TokenType::FUNC);
 
@@ -293,13 +427,15 @@ struct Parser {
     std::unique_ptr<Statement> parse_return_statement() {
         expect(TokenType::RET);
 
-        std::unique_ptr<Expression> value = nullptr;
+        std::vector<std::unique_ptr<Expression>> values;
         if (current_token().type != TokenType::SEMICOLON) {
-            value = parse_expression(0);
+            do {
+                values.push_back(parse_expression(0));
+            } while (match(TokenType::COMMA));
         }
 
         expect(TokenType::SEMICOLON);
-        return std::make_unique<ReturnStatement>(std::move(value));
+        return std::make_unique<ReturnStatement>(std::move(values));
     }
     std::unique_ptr<Statement> parse_block_statement() {
         expect(TokenType::OPEN_CURLY);
@@ -349,6 +485,8 @@ struct Parser {
                 return parse_if_statement();
             case TokenType::WHILE:
                 return parse_while_statement();
+            case TokenType::PFOR:
+                return parse_pfor_statement();
             case TokenType::RET:
                 return parse_return_statement();
             case TokenType::OPEN_CURLY:
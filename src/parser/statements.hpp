@@ -33,6 +33,25 @@ struct VariableDeclaration : public Statement {
         }
     }
 };
+struct DestructuringDeclaration : public Statement {
+    std::vector<std::string> names;
+    std::unique_ptr<Expression> initializer;
+
+    DestructuringDeclaration(std::vector<std::string> n, std::unique_ptr<Expression> init)
+        : names(std::move(n)), initializer(std::move(init)) {}
+
+    void print(int indent = 0) const override {
+        std::cout << std::string(indent, ' ') << "DestructuringDeclaration:" << std::endl;
+        std::cout << std::string(indent + 2, ' ') << "Names: ";
+        for (size_t i = 0; i < names.size(); ++i) {
+            std::cout << names[i];
+            if (i < names.size() - 1) std::cout << ", ";
+        }
+        std::cout << std::endl;
+        std::cout << std::string(indent + 2, ' ') << "Initializer:" << std::endl;
+        initializer->print(indent + 4);
+    }
+};
 struct AssignmentStatement : public Statement {
     std::string variable_name;
     std::unique_ptr<Expression> value;
@@ -48,13 +67,13 @@ struct AssignmentStatement : public Statement {
     }
 };
 struct ReturnStatement : public Statement {
-    std::unique_ptr<Expression> value;
+    std::vector<std::unique_ptr<Expression>> values;
 
-    ReturnStatement(std::unique_ptr<Expression> val = nullptr) : value(std::move(val)) {}
+    ReturnStatement(std::vector<std::unique_ptr<Expression>> vals = {}) : values(std::move(vals)) {}
 
     void print(int indent = 0) const override {
         std::cout << std::string(indent, ' ') << "ReturnStatement:" << std::endl;
-        if (value) {
+        for (const auto& value : values) {
             std::cout << std::string(indent + 2, ' ') << "Value:" << std::endl;
             value->print(indent + 4);
         }
@@ -137,6 +156,20 @@ struct WhileStatement : public Statement {
         body->print(indent + 4);
     }
 };
+// pfor (x in data_ROOM) body: every element goes through body on some thread, x written back in place
+struct PforStatement : public Statement {
+    std::string variable_name;
+    std::string room_name;
+    std::unique_ptr<Statement> body;
+
+    PforStatement(const std::string& var, const std::string& room, std::unique_ptr<Statement> body_stmt)
+        : variable_name(var), room_name(room), body(std::move(body_stmt)) {}
+
+    void print(int indent = 0) const override {
+        std::cout << std::string(indent, ' ') << "PforStatement: " << variable_name << " in " << room_name << std::endl;
+        body->print(indent + 2);
+    }
+};
 struct BlockStatement : public Statement {
     std::vector<std::unique_ptr<Statement>> statements;
 
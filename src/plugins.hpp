@@ -0,0 +1,237 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <stdexcept>
+#include <filesystem>
+#include <unordered_set>
+#include "parser/functions.hpp"
+#include "asterisk_plugin.h"
+
+#ifdef _WIN32
+#include "win32.hpp"
+#else
+#include <dlfcn.h>
+#endif
+
+// Loads native builtins out of shared libraries (see asterisk_plugin.h)
+class PluginLoader {
+private:
+    struct NativeFunction {
+        std::string name;
+        ast_native_function function;
+        void* user_data;
+    };
+
+    std::vector<void*> handles;
+
+    struct RegisterContext {
+        FunctionRegistry* registry;
+        const std::unordered_set<std::string>* reserved;  // builtin names a plugin can't take over
+        std::string error;
+    };
+
+    static std::string library_extension() {
+#if defined(_WIN32)
+        return ".dll";
+#elif defined(__APPLE__)
+        return ".dylib";
+#else
+        return ".so";
+#endif
+    }
+
+    static void* open_library(const std::string& path) {
+#ifdef _WIN32
+        void* handle = LoadLibraryA(path.c_str());
+        if (!handle) {
+            throw std::runtime_error("Failed to load plugin: " + path);
+        }
+#else
+        void* handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+        if (!handle) {
+            throw std::runtime_error("Failed to load plugin: " + std::string(dlerror()));
+        }
+#endif
+        return handle;
+    }
+
+    static void* find_symbol(void* handle, const char* name) {
+#ifdef _WIN32
+        return GetProcAddress(handle, name);
+#else
+        return dlsym(handle, name);
+#endif
+    }
+
+    static void close_library(void* handle) {
+#ifdef _WIN32
+        FreeLibrary(handle);
+#else
+        dlclose(handle);
+#endif
+    }
+
+    // rooms get flattened into storage so the pointers stay valid for the whole call
+    static ast_value to_native(const Value& val, std::deque<std::vector<ast_value>>& storage) {
+        ast_value out{};
+        if (auto i = val.get_if<int>()) {
+            out.type = AST_VALUE_INT;
+            out.as.i = *i;
+        } else if (auto f = val.get_if<float>()) {
+            out.type = AST_VALUE_FLOAT;
+            out.as.f = *f;
+        } else if (auto s = val.get_if<std::string>()) {
+            out.type = AST_VALUE_STRING;
+            out.as.s.data = s->data();
+            out.as.s.length = s->size();
+        } else if (auto b = val.get_if<bool>()) {
+            out.type = AST_VALUE_BOOL;
+            out.as.b = *b ? 1 : 0;
+        } else if (auto room_ptr = val.get_if<ValueArray>()) {
+            const ValueArray& room = *room_ptr;
+            storage.emplace_back();
+            std::vector<ast_value>& items = storage.back();
+            items.reserve(room.size());
+            for (const auto& element : room) {
+                items.push_back(to_native(element, storage));
+            }
+            out.type = AST_VALUE_ROOM;
+            out.as.room.items = items.data();
+            out.as.room.length = items.size();
+        } else {
+            throw std::runtime_error("Big integers and keyed rooms can't be passed to native plugins");
+        }
+        return out;
+    }
+
+    static Value from_native(const ast_value& val) {
+        switch (val.type) {
+            case AST_VALUE_INT: return static_cast<int>(val.as.i);
+            case AST_VALUE_FLOAT: return val.as.f;
+            case AST_VALUE_STRING:
+                if (!val.as.s.data) {
+                    if (val.as.s.length != 0) throw std::runtime_error("Plugin returned a string with no data");
+                    return std::string();
+                }
+                return std::string(val.as.s.data, val.as.s.length);
+            case AST_VALUE_BOOL: return val.as.b != 0;
+            case AST_VALUE_ROOM: {
+                if (!val.as.room.items && val.as.room.length != 0) {
+                    throw std::runtime_error("Plugin returned a room with no items");
+                }
+                ValueVector elements;
+                elements.reserve(val.as.room.length);
+                for (size_t i = 0; i < val.as.room.length; ++i) {
+                    elements.push_back(from_native(val.as.room.items[i]));
+                }
+                return ValueArray(std::move(elements));
+            }
+            default:
+                throw std::runtime_error("Plugin returned unknown value type " + std::to_string(val.type));
+        }
+    }
+
+    static int register_function(void* host, const char* name, ast_native_function function, void* user_data) {
+        auto* context = static_cast<RegisterContext*>(host);
+        if (!name || !function) return 1;
+        if (context->reserved->count(name)) {
+            if (context->error.empty()) context->error = std::string(name) + " is already a builtin";
+            return 1;
+        }
+
+        NativeFunction native{name, function, user_data};
+        context->registry->register_function(native.name, [native](const ValueVector& args) -> Value {
+            std::deque<std::vector<ast_value>> storage;
+            std::vector<ast_value> native_args;
+            native_args.reserve(args.size());
+            for (const auto& arg : args) {
+                native_args.push_back(to_native(arg, storage));
+            }
+
+            ast_value result{};
+            result.type = AST_VALUE_INT;
+            int status = native.function(native_args.data(), native_args.size(), &result, native.user_data);
+            if (status != 0) {
+                std::string message = native.name + "() failed";
+                if (result.type == AST_VALUE_STRING && result.as.s.data) {
+                    message += ": " + std::string(result.as.s.data, result.as.s.length);
+                }
+                throw std::runtime_error(message);
+            }
+            return from_native(result);
+        });
+        return 0;
+    }
+
+public:
+    PluginLoader() = default;
+    PluginLoader(const PluginLoader&) = delete;
+    PluginLoader& operator=(const PluginLoader&) = delete;
+
+    ~PluginLoader() {
+        for (void* handle : handles) {
+            close_library(handle);
+        }
+    }
+
+    void load_plugin(const std::string& path, FunctionRegistry& registry, const std::unordered_set<std::string>& reserved) {
+        void* handle = open_library(path);
+
+        // structs that changed layout would be read as garbage, so a plugin has to say what it was built against
+        auto abi_version = reinterpret_cast<ast_plugin_abi_function>(find_symbol(handle, ASTERISK_PLUGIN_ABI_ENTRY));
+        if (!abi_version) {
+            close_library(handle);
+            throw std::runtime_error("Plugin " + path + " does not export " + ASTERISK_PLUGIN_ABI_ENTRY +
+                                     ", rebuild it with ASTERISK_PLUGIN_DECLARE_ABI()");
+        }
+        uint32_t version = abi_version();
+        if (version != ASTERISK_PLUGIN_ABI_VERSION) {
+            close_library(handle);
+            throw std::runtime_error("Plugin " + path + " was built for plugin ABI " + std::to_string(version) +
+                                     ", this interpreter has " + std::to_string(ASTERISK_PLUGIN_ABI_VERSION));
+        }
+
+        auto entry = reinterpret_cast<ast_plugin_register_function>(find_symbol(handle, ASTERISK_PLUGIN_ENTRY));
+        if (!entry) {
+            close_library(handle);
+            throw std::runtime_error("Plugin " + path + " does not export " + ASTERISK_PLUGIN_ENTRY);
+        }
+
+        RegisterContext context{&registry, &reserved, ""};
+        ast_host_api api{};
+        api.abi_version = ASTERISK_PLUGIN_ABI_VERSION;
+        api.host = &context;
+        api.register_function = &PluginLoader::register_function;
+
+        // keep the library open even if it fails, it may have registered some functions already
+        handles.push_back(handle);
+        int status = entry(&api);
+        if (!context.error.empty()) {
+            throw std::runtime_error("Plugin " + path + " failed to register: " + context.error);
+        }
+        if (status != 0) {
+            throw std::runtime_error("Plugin " + path + " failed to register");
+        }
+    }
+
+    // loads every shared library in the folder, missing folder just means no plugins
+    void load_directory(const std::string& directory, FunctionRegistry& registry, const std::unordered_set<std::string>& reserved) {
+        namespace fs = std::filesystem;
+        if (!fs::is_directory(directory)) return;
+
+        std::vector<std::string> paths;
+        for (const auto& entry : fs::directory_iterator(directory)) {
+            if (entry.is_regular_file() && entry.path().extension() == library_extension()) {
+                paths.push_back(entry.path().string());
+            }
+        }
+        // directory order isn't stable, and the last plugin to register a name wins
+        std::sort(paths.begin(), paths.end());
+
+        for (const auto& path : paths) {
+            load_plugin(path, registry, reserved);
+        }
+    }
+};
@@ -0,0 +1,239 @@
+#pragma once
+#include <string>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include "lexer.hpp"
+#include "parser/parser.hpp"
+#include "parser/functions.hpp"
+#include "plugins.hpp"
+#include "tiering.hpp"
+#include "builtins/random.hpp"
+#include "builtins/stats.hpp"
+#include "builtins/aggregate.hpp"
+#include "builtins/io.hpp"
+#include "builtins/csv.hpp"
+#include "builtins/json.hpp"
+#include "builtins/persist.hpp"
+#include "builtins/async_io.hpp"
+#include "builtins/format.hpp"
+#include "builtins/stdin.hpp"
+#include "builtins/shared.hpp"
+#include "builtins/channels.hpp"
+#include "builtins/atomics.hpp"
+
+struct UserFunction {
+    std::vector<std::string> parameters;
+    const Statement* body;
+    FunctionTier* tier = nullptr;  // only top-level functions get tiered
+
+    UserFunction(std::vector<std::string> params, const Statement* func_body)
+        : parameters(std::move(params)), body(func_body) {}
+};
+
+// builtins that only look at their arguments, so pmap()/preduce() can call them from any thread
+// in any order. Anything not in here (I/O, rand, channels, plugins...) makes a function impure.
+const std::unordered_set<std::string> PURE_BUILTINS = {
+    "round", "floor", "ceil", "abs", "min", "max", "sqrt", "pow", "len", "frag", "keys", "has",
+    "group_by", "format", "json_parse", "json_stringify", "mean", "variance", "stddev", "percentile",
+    "median", "histogram", "shm_len", "shm_get",
+};
+
+// builtins the Interpreter runs itself because they need the run (its tasks, isolates, timers)
+const std::unordered_set<std::string> INTRINSICS = {
+    "checkpoint", "pmap", "preduce", "isolate", "tell", "isolate_state", "isolate_stop",
+    "set_timeout", "set_interval", "clear_timer", "run",
+};
+
+// every function a piece of code calls by name, and whether it spawns or awaits tasks
+struct CallSummary {
+    std::vector<std::string> calls;
+    bool uses_tasks = false;
+
+    void add_expression(const Expression* expr) {
+        if (auto access = dynamic_cast<const RoomAccess*>(expr)) {
+            add_expression(access->index.get());
+        } else if (auto binary = dynamic_cast<const BinaryExpression*>(expr)) {
+            add_expression(binary->left.get());
+            add_expression(binary->right.get());
+        } else if (auto unary = dynamic_cast<const UnaryExpression*>(expr)) {
+            add_expression(unary->operand.get());
+        } else if (auto paren = dynamic_cast<const ParenthesizedExpression*>(expr)) {
+            add_expression(paren->expression.get());
+        } else if (auto call = dynamic_cast<const FunctionCall*>(expr)) {
+            calls.push_back(call->function_name);
+            for (const auto& arg : call->arguments) {
+                add_expression(arg.get());
+            }
+        } else if (auto room = dynamic_cast<const RoomLiteral*>(expr)) {
+            for (const auto& element : room->elements) {
+                add_expression(element.get());
+            }
+        } else if (dynamic_cast<const SpawnExpression*>(expr) || dynamic_cast<const AwaitExpression*>(expr)) {
+            uses_tasks = true;
+        }
+    }
+
+    void add_statement(const Statement* stmt) {
+        if (auto var_decl = dynamic_cast<const VariableDeclaration*>(stmt)) {
+            if (var_decl->initializer) add_expression(var_decl->initializer.get());
+        } else if (auto destructure = dynamic_cast<const DestructuringDeclaration*>(stmt)) {
+            add_expression(destructure->initializer.get());
+        } else if (auto assign = dynamic_cast<const AssignmentStatement*>(stmt)) {
+            add_expression(assign->value.get());
+        } else if (auto room_assign = dynamic_cast<const RoomAssignmentStatement*>(stmt)) {
+            add_expression(room_assign->index.get());
+            add_expression(room_assign->value.get());
+        } else if (auto expr_stmt = dynamic_cast<const ExpressionStatement*>(stmt)) {
+            add_expression(expr_stmt->expression.get());
+        } else if (auto if_stmt = dynamic_cast<const IfStatement*>(stmt)) {
+            add_expression(if_stmt->condition.get());
+            add_statement(if_stmt->then_statement.get());
+            if (if_stmt->else_statement) add_statement(if_stmt->else_statement.get());
+        } else if (auto while_stmt = dynamic_cast<const WhileStatement*>(stmt)) {
+            add_expression(while_stmt->condition.get());
+            add_statement(while_stmt->body.get());
+        } else if (auto pfor = dynamic_cast<const PforStatement*>(stmt)) {
+            add_statement(pfor->body.get());
+        } else if (auto block = dynamic_cast<const BlockStatement*>(stmt)) {
+            for (const auto& statement : block->statements) {
+                add_statement(statement.get());
+            }
+        } else if (auto ret = dynamic_cast<const ReturnStatement*>(stmt)) {
+            for (const auto& value : ret->values) {
+                add_expression(value.get());
+            }
+        }
+    }
+};
+
+/*
+    Everything about a script that doesn't change while it runs: the AST, the functions it
+    declares at the top level, and the builtins (plus any plugins). Nothing in here is written
+    after compile() returns, so any number of Interpreters on any number of threads can run
+    the same CompiledProgram at once without locking. Each Interpreter is one run: its own
+    variables, call stack and tasks. The exception is tiering (hot functions getting swapped
+    over to closures), which is all atomics and the compile thread's own lock.
+
+    Only builtins without state live in here. The ones that keep state (the random generator,
+    open files, channels, stdin...) get made fresh for every run by run_builtins(), so one run
+    seeding rand() or opening a file doesn't show up in another, and runs never lock each other.
+*/
+class CompiledProgram {
+private:
+    std::unique_ptr<Program> program;
+    std::unordered_map<std::string, UserFunction> functions;
+    std::unordered_map<std::string, std::string> impure_calls;  // function -> the call that makes it impure
+    PluginLoader plugin_loader;
+    std::unique_ptr<FunctionRegistry> registry;  // after plugin_loader, so it's gone before the plugins are unloaded
+    std::vector<std::unique_ptr<FunctionTier>> function_tiers;
+    mutable TierCompiler tier_compiler;  // last, so its thread is stopped before anything it compiles from goes
+
+    CompiledProgram(std::unique_ptr<Program> ast, const std::string& plugin_directory)
+        : program(std::move(ast)), registry(std::make_unique<FunctionRegistry>()) {
+        register_stats_functions(*registry);
+        register_aggregate_functions(*registry);
+        register_json_functions(*registry);
+        register_persist_functions(*registry);
+        register_format_functions(*registry);
+        if (!plugin_directory.empty()) {
+            // plugins can add builtins but not replace one, the run's own builtins and intrinsics included
+            std::unordered_set<std::string> reserved(INTRINSICS);
+            for (const auto& name : run_builtins()->get_function_names()) {
+                reserved.insert(name);
+            }
+            plugin_loader.load_directory(plugin_directory, *registry, reserved);
+        }
+
+        // top-level functions can be called from anywhere in the script, the first one with a name wins
+        for (const auto& statement : program->statements) {
+            if (auto func_decl = dynamic_cast<const FunctionDeclaration*>(statement.get())) {
+                auto [it, added] = functions.emplace(func_decl->name, UserFunction(func_decl->parameters, func_decl->body.get()));
+                if (added) {
+                    function_tiers.push_back(std::make_unique<FunctionTier>());
+                    it->second.tier = function_tiers.back().get();
+                }
+            }
+        }
+        find_impure_functions();
+    }
+
+    // A function is pure if everything it calls is a pure builtin or a pure function. Start from
+    // the ones that call something impure directly and keep spreading to their callers.
+    void find_impure_functions() {
+        std::unordered_map<std::string, CallSummary> summaries;
+        for (const auto& [name, func] : functions) {
+            CallSummary& summary = summaries[name];
+            summary.add_statement(func.body);
+            if (summary.uses_tasks) {
+                impure_calls[name] = "spawn";
+                continue;
+            }
+            for (const auto& callee : summary.calls) {
+                if (!functions.count(callee) && !PURE_BUILTINS.count(callee)) {
+                    impure_calls[name] = callee;
+                    break;
+                }
+            }
+        }
+
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (const auto& [name, summary] : summaries) {
+                if (impure_calls.count(name)) continue;
+                for (const auto& callee : summary.calls) {
+                    auto it = impure_calls.find(callee);
+                    if (it != impure_calls.end()) {
+                        impure_calls[name] = it->second;
+                        changed = true;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+public:
+    static std::shared_ptr<const CompiledProgram> compile(const std::string& source, const std::string& plugin_directory = "") {
+        std::vector<Token> tokens = lexer(source);
+        Parser parser(tokens);
+        return std::shared_ptr<const CompiledProgram>(new CompiledProgram(parser.parse_program(), plugin_directory));
+    }
+
+    CompiledProgram(const CompiledProgram&) = delete;
+    CompiledProgram& operator=(const CompiledProgram&) = delete;
+
+    const Program& statements() const { return *program; }
+
+    const UserFunction* find_function(const std::string& name) const {
+        auto it = functions.find(name);
+        return it == functions.end() ? nullptr : &it->second;
+    }
+
+    // the impure builtin a top-level function ends up calling, or empty if it's pure
+    std::string impure_call(const std::string& name) const {
+        auto it = impure_calls.find(name);
+        return it == impure_calls.end() ? std::string() : it->second;
+    }
+
+    TierCompiler& tiers() const { return tier_compiler; }
+
+    // the registry is only read once compile() is done, and the builtins in it keep no state
+    const FunctionRegistry& builtins() const { return *registry; }
+
+    // A run's own copy of the builtins that keep state, on top of the shared ones. Its tasks,
+    // pfor workers and isolates share it, so those still lock for themselves.
+    std::shared_ptr<FunctionRegistry> run_builtins() const {
+        auto run = std::make_shared<FunctionRegistry>(registry.get());
+        register_random_functions(*run);
+        register_io_functions(*run);
+        register_csv_functions(*run);
+        register_async_io_functions(*run);
+        register_stdin_functions(*run);
+        register_shared_functions(*run);
+        register_channel_functions(*run);
+        register_atomic_functions(*run);
+        return run;
+    }
+};
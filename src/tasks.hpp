@@ -0,0 +1,110 @@
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <memory>
+#include <thread>
+#include <algorithm>
+#include "parser/functions.hpp"
+#include "builtins/handles.hpp"
+#include "thread_pool.hpp"
+
+// One spawned call. Whoever claims it first runs it: a pool thread, or an await that
+// gets there before the pool does (so waiting on tasks never ties up every thread).
+class Task {
+private:
+    enum State { PENDING, RUNNING, DONE };
+
+    std::atomic<int> state{PENDING};
+    std::function<Value()> body;
+    Value result;
+    std::exception_ptr error;
+    std::mutex mutex;
+    std::condition_variable finished;
+
+public:
+    explicit Task(std::function<Value()> job) : body(std::move(job)) {}
+
+    bool claim() {
+        int expected = PENDING;
+        return state.compare_exchange_strong(expected, RUNNING);
+    }
+
+    void run() {
+        try {
+            result = body();
+        } catch (...) {
+            error = std::current_exception();
+        }
+        body = nullptr;  // drops the task's interpreter context as soon as it's done
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            state.store(DONE);
+        }
+        finished.notify_all();
+    }
+
+    Value wait() {
+        if (claim()) {
+            run();
+        } else {
+            std::unique_lock<std::mutex> lock(mutex);
+            finished.wait(lock, [this] { return state.load() == DONE; });
+        }
+        if (error) std::rethrow_exception(error);
+        return std::move(result);
+    }
+};
+
+const size_t TASK_THREAD_LIMIT = 256;
+
+class TaskScheduler {
+private:
+    HandleTable<Task> tasks;
+    std::mutex mutex;
+    std::condition_variable idle;
+    size_t outstanding = 0;
+    ThreadPool pool;  // last, so it's gone (and its threads joined) before anything it uses
+
+public:
+    // tasks can block on channels and on each other, so the pool grows instead of letting queued tasks starve
+    TaskScheduler() : pool(std::max(1u, std::thread::hardware_concurrency()), TASK_THREAD_LIMIT) {}
+
+    int spawn(std::function<Value()> job) {
+        auto task = std::make_shared<Task>(std::move(job));
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ++outstanding;
+        }
+        pool.submit([this, task] {
+            if (task->claim()) task->run();
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--outstanding == 0) idle.notify_all();
+        });
+        return tasks.add(task);
+    }
+
+    // the task's return value, or its error rethrown here. A handle can only be awaited once.
+    Value await(const Value& handle) {
+        auto task = tasks.get(handle, "await");
+        tasks.remove(handle, "await");
+        return task->wait();
+    }
+
+    // spawned and not awaited yet, or still running
+    bool busy() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (outstanding > 0) return true;
+        }
+        return tasks.size() > 0;
+    }
+
+    // blocks until every spawned task has finished, awaited or not
+    void wait_idle() {
+        std::unique_lock<std::mutex> lock(mutex);
+        idle.wait(lock, [this] { return outstanding == 0; });
+    }
+};
@@ -0,0 +1,73 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+
+// Worker threads pulling jobs off one queue. Threads start on the first submit, so scripts
+// that never use it don't pay for them. If jobs can block on each other (tasks waiting on a
+// channel), give it a max_threads above threads: when a job comes in and every worker is
+// busy, another worker gets started, so a queued job never waits behind blocked ones.
+class ThreadPool {
+private:
+    std::mutex mutex;
+    std::condition_variable work_available;
+    std::deque<std::function<void()>> jobs;
+    std::vector<std::thread> workers;
+    size_t thread_count;
+    size_t max_threads;
+    size_t idle = 0;
+    bool stopping = false;
+
+    void work() {
+        while (true) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                ++idle;
+                work_available.wait(lock, [this] { return stopping || !jobs.empty(); });
+                --idle;
+                if (jobs.empty()) return;
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+            job();
+        }
+    }
+
+public:
+    explicit ThreadPool(size_t threads, size_t max_threads = 0)
+        : thread_count(std::max<size_t>(1, threads)), max_threads(std::max(thread_count, max_threads)) {}
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        work_available.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    void submit(std::function<void()> job) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (workers.empty()) {
+                for (size_t i = 0; i < thread_count; ++i) {
+                    workers.emplace_back(&ThreadPool::work, this);
+                }
+            } else if (idle <= jobs.size() && workers.size() < max_threads) {
+                workers.emplace_back(&ThreadPool::work, this);
+            }
+            jobs.push_back(std::move(job));
+        }
+        work_available.notify_one();
+    }
+};
@@ -0,0 +1,96 @@
+#pragma once
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <cstdint>
+
+class Interpreter;
+
+enum class ExecResult { NORMAL, RETURN };
+
+// a function this many calls in gets queued for the closure tier
+const uint32_t TIER_UP_CALLS = 1000;
+
+// A function body turned into a tree of closures (see Interpreter::compile_statement). Same
+// semantics as walking the AST, minus the dynamic_cast chain on every node and with calls
+// to known functions already looked up.
+struct FastCode {
+    std::function<ExecResult(Interpreter&)> body;
+};
+
+// Tiering state for one top-level function, shared by every thread running the program.
+// code stays null (baseline) until the background compile is done.
+struct FunctionTier {
+    std::atomic<uint32_t> calls{0};
+    std::atomic<bool> queued{false};
+    std::atomic<const FastCode*> code{nullptr};
+};
+
+/*
+    Compiles hot functions on a thread of its own, so the thread that noticed a function is hot
+    never stops to compile it. It keeps running the AST and picks up the closures on the next
+    call after they're published. The thread starts with the first function that gets hot.
+*/
+class TierCompiler {
+private:
+    using CompileFn = std::function<std::unique_ptr<FastCode>()>;
+
+    std::mutex mutex;
+    std::condition_variable work_available;
+    std::deque<std::pair<FunctionTier*, CompileFn>> queue;
+    std::vector<std::unique_ptr<FastCode>> finished;  // kept until the program goes, someone might still be running it
+    std::thread worker;
+    bool stopping = false;
+
+    void work() {
+        while (true) {
+            std::pair<FunctionTier*, CompileFn> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                work_available.wait(lock, [this] { return stopping || !queue.empty(); });
+                if (stopping) return;
+                job = std::move(queue.front());
+                queue.pop_front();
+            }
+            std::unique_ptr<FastCode> code;
+            try {
+                code = job.second();
+            } catch (...) {
+                continue;  // stays on the baseline tier, which still works
+            }
+            job.first->code.store(code.get(), std::memory_order_release);
+            std::lock_guard<std::mutex> lock(mutex);
+            finished.push_back(std::move(code));
+        }
+    }
+
+public:
+    TierCompiler() = default;
+    TierCompiler(const TierCompiler&) = delete;
+    TierCompiler& operator=(const TierCompiler&) = delete;
+
+    ~TierCompiler() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        work_available.notify_one();
+        if (worker.joinable()) worker.join();
+    }
+
+    // only the first request for a function does anything
+    void enqueue(FunctionTier& tier, CompileFn compile) {
+        if (tier.queued.exchange(true)) return;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!worker.joinable()) worker = std::thread(&TierCompiler::work, this);
+            queue.emplace_back(&tier, std::move(compile));
+        }
+        work_available.notify_one();
+    }
+};
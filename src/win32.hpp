@@ -0,0 +1,39 @@
+#pragma once
+#ifdef _WIN32
+#include <cstddef>
+#include <cstdint>
+
+/*
+    The few kernel32 calls the interpreter needs, declared by hand. windows.h can't be included
+    anywhere that also sees lexer.hpp: it typedefs INT, BOOL, FLOAT and CHAR and #defines IN,
+    which all clash with TokenType.
+*/
+extern "C" {
+__declspec(dllimport) void* __stdcall LoadLibraryA(const char* path);
+__declspec(dllimport) void* __stdcall GetProcAddress(void* module, const char* name);
+__declspec(dllimport) int __stdcall FreeLibrary(void* module);
+
+__declspec(dllimport) void* __stdcall CreateFileA(const char* path, unsigned long access, unsigned long share_mode,
+                                                  void* security, unsigned long disposition,
+                                                  unsigned long flags, void* template_file);
+__declspec(dllimport) unsigned long __stdcall GetFileSize(void* file, unsigned long* size_high);
+__declspec(dllimport) void* __stdcall CreateFileMappingA(void* file, void* security, unsigned long protect,
+                                                         unsigned long size_high, unsigned long size_low,
+                                                         const char* name);
+__declspec(dllimport) void* __stdcall MapViewOfFile(void* mapping, unsigned long access, unsigned long offset_high,
+                                                    unsigned long offset_low, size_t bytes);
+__declspec(dllimport) int __stdcall UnmapViewOfFile(const void* address);
+__declspec(dllimport) int __stdcall CloseHandle(void* handle);
+__declspec(dllimport) unsigned long __stdcall GetLastError();
+}
+
+const unsigned long WIN32_GENERIC_READ = 0x80000000UL;
+const unsigned long WIN32_FILE_SHARE_READ = 0x00000001UL;
+const unsigned long WIN32_OPEN_EXISTING = 3;
+const unsigned long WIN32_FILE_FLAG_SEQUENTIAL_SCAN = 0x08000000UL;
+const unsigned long WIN32_INVALID_FILE_SIZE = 0xFFFFFFFFUL;
+const unsigned long WIN32_NO_ERROR = 0;
+const unsigned long WIN32_PAGE_READONLY = 0x02;
+const unsigned long WIN32_FILE_MAP_READ = 0x0004;
+inline void* const WIN32_INVALID_HANDLE = reinterpret_cast<void*>(static_cast<intptr_t>(-1));
+#endif